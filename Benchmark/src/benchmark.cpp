@@ -0,0 +1,276 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <algorithm>
+#include <chrono>
+#include <stdexcept>
+#include <vector>
+
+#include <x86intrin.h>
+
+#include <ipp.h>
+#include <ippcp.h>
+
+#include "asymmetric.h"
+#include "hasher.h"
+#include "symmetric.h"
+
+#define BENCH_MIN_SIZE    16
+#define BENCH_MAX_SIZE    (1 << 30)    // 1 GB
+#define BENCH_MIN_TIME    0.2          // Seconds per measurement
+#define BENCH_RSA_SAMPLES 20           // Key generations per RSA key size
+#define BENCH_SEPARATOR   "-----------------------------------------------------------------------------------------"
+
+struct BenchResult
+{
+    double seconds;
+    uint64_t cycles;
+    uint64_t iterations;
+};
+
+static double minTime = BENCH_MIN_TIME;
+
+/// Repeats func until minTime is reached and returns elapsed time and TSC cycles
+template <class Func>
+static BenchResult measure(Func func)
+{
+    BenchResult res = {0, 0, 0};
+
+    func();    // Warm up caches and IPP dispatch
+    auto start      = std::chrono::steady_clock::now();
+    uint64_t tStart = __rdtsc();
+    do
+    {
+        func();
+        ++res.iterations;
+        res.seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    } while (res.seconds < minTime);
+    res.cycles = __rdtsc() - tStart;
+
+    return res;
+}
+
+static void printThroughput(const char *name, size_t size, const BenchResult &res)
+{
+    const double bytes = (double)size * res.iterations;
+    printf("%-24s %12zu B %12.2f MB/s %10.2f cycles/B\n", name, size, bytes / res.seconds / 1e6, res.cycles / bytes);
+}
+
+static void printOps(const char *name, int bits, const BenchResult &res)
+{
+    printf("%-24s %8d bit %12.1f ops/s %12.1f us/op\n",
+           name,
+           bits,
+           res.iterations / res.seconds,
+           res.seconds * 1e6 / res.iterations);
+}
+
+static void printLibInfo()
+{
+    const IppLibraryVersion *ipp   = ippsGetLibVersion();
+    const IppLibraryVersion *ippcp = ippcpGetLibVersion();
+
+    // The CPU specific suffix of the library name (e.g. l9 = AVX2, k0 = AVX-512) shows the dispatched code path
+    printf("%s\n", BENCH_SEPARATOR);
+    printf("IPP   : %s %s\n", ipp->Name, ipp->Version);
+    printf("IPPCP : %s %s\n", ippcp->Name, ippcp->Version);
+    printf("Enabled CPU features (ipp / ippcp) : 0x%016llx / 0x%016llx\n",
+           (unsigned long long)ippGetEnabledCpuFeatures(),
+           (unsigned long long)ippcpGetEnabledCpuFeatures());
+    printf("%s\n", BENCH_SEPARATOR);
+}
+
+static void benchSymmetric(Ipp8u *src, Ipp8u *dst, size_t maxSize)
+{
+    const size_t keyBits[] = {128, 192, 256};
+    Ipp8u key[32];
+    Ipp8u ctr[AES_CTR_SIZE];
+
+    for (size_t n = 0; n < sizeof(key); ++n)
+        key[n] = rand();
+
+    for (size_t bits : keyBits)
+    {
+        AES_Crypt aes(key, bits);
+        char name[32];
+        snprintf(name, sizeof(name), "AES-%zu-CTR", bits);
+
+        for (size_t size = BENCH_MIN_SIZE; size <= maxSize; size *= 4)
+        {
+            BenchResult res = measure([&]() {
+                memset(ctr, 1, AES_CTR_SIZE);
+                aes.encryptMessage(src, (int)size, dst, ctr, AES_CTR_SIZE * 8);
+            });
+            printThroughput(name, size, res);
+        }
+    }
+
+    SMS4_Crypt sms4(key, 128);
+    for (size_t size = BENCH_MIN_SIZE; size <= maxSize; size *= 4)
+    {
+        BenchResult res = measure([&]() {
+            memset(ctr, 1, SMS4_CTR_SIZE);
+            sms4.encryptMessage(src, (int)size, dst, ctr, SMS4_CTR_SIZE * 8);
+        });
+        printThroughput("SMS4-128-CTR", size, res);
+    }
+}
+
+static void benchHash(Ipp8u *src, size_t maxSize)
+{
+    const struct
+    {
+        IppHashAlgId id;
+        const char *name;
+    } algs[] = {{ippHashAlg_SHA1, "SHA1"},
+                {ippHashAlg_SHA224, "SHA224"},
+                {ippHashAlg_SHA256, "SHA256"},
+                {ippHashAlg_SHA384, "SHA384"},
+                {ippHashAlg_SHA512, "SHA512"},
+                {ippHashAlg_SHA512_224, "SHA512/224"},
+                {ippHashAlg_SHA512_256, "SHA512/256"},
+                {ippHashAlg_MD5, "MD5"},
+                {ippHashAlg_SM3, "SM3"}};
+    Ipp8u digest[IPP_SHA512_DIGEST_BITSIZE / 8];
+
+    for (const auto &alg : algs)
+    {
+        Hash_Coder coder(alg.id);
+        for (size_t size = BENCH_MIN_SIZE; size <= maxSize; size *= 4)
+        {
+            BenchResult res = measure([&]() {
+                coder.update(src, size);
+                coder.getHash(digest);
+            });
+            printThroughput(alg.name, size, res);
+        }
+    }
+}
+
+static void benchRSA(int nSamples)
+{
+    const int keyBits[] = {1024, 2048, 3072, 4096};
+    Ipp8u msg[32];
+
+    for (size_t n = 0; n < sizeof(msg); ++n)
+        msg[n] = rand();
+
+    for (int bits : keyBits)
+    {
+        // Key generation latency
+        std::vector<double> latency;
+        for (int n = 0; n < nSamples; ++n)
+        {
+            auto start = std::chrono::steady_clock::now();
+            RSA_Crypt rsa(bits);
+            auto stop = std::chrono::steady_clock::now();
+            latency.push_back(std::chrono::duration<double, std::milli>(stop - start).count());
+        }
+        std::sort(latency.begin(), latency.end());
+        auto pct = [&](double p) { return latency[std::min(latency.size() - 1, (size_t)(p * latency.size()))]; };
+        printf("%-24s %8d bit   p50 %10.1f ms   p90 %10.1f ms   p99 %10.1f ms   max %10.1f ms\n",
+               "RSA keygen",
+               bits,
+               pct(0.50),
+               pct(0.90),
+               pct(0.99),
+               latency.back());
+
+        // Operations on a single key
+        RSA_Crypt rsa(bits);
+        std::vector<Ipp8u> cipher(bits / 8), plain(bits / 8), sign(bits / 8);
+        int lenplain = 0;
+        bool valid   = false;
+
+        BenchResult res;
+        res = measure([&]() { rsa.encryptMessage(msg, sizeof(msg), cipher.data()); });
+        printOps("RSA-OAEP encrypt", bits, res);
+        res = measure([&]() { rsa.decryptMessage(cipher.data(), plain.data(), lenplain); });
+        printOps("RSA-OAEP decrypt", bits, res);
+        res = measure([&]() { rsa.sign(msg, sizeof(msg), sign.data()); });
+        printOps("RSA-PSS sign", bits, res);
+        res = measure([&]() { rsa.verify(msg, sizeof(msg), sign.data(), valid); });
+        printOps("RSA-PSS verify", bits, res);
+    }
+}
+
+int main(int argc, char **argv)
+{
+    size_t maxSize = BENCH_MAX_SIZE;
+    int nSamples   = BENCH_RSA_SAMPLES;
+    bool runSym = true, runHash = true, runRSA = true;
+
+    for (int i = 1; i < argc; ++i)
+    {
+        if (!strcmp(argv[i], "--max-size") && i + 1 < argc)
+            maxSize = strtoull(argv[++i], nullptr, 10);
+        else if (!strcmp(argv[i], "--min-time") && i + 1 < argc)
+            minTime = atof(argv[++i]);
+        else if (!strcmp(argv[i], "--rsa-samples") && i + 1 < argc)
+            nSamples = atoi(argv[++i]);
+        else if (!strcmp(argv[i], "--only") && i + 1 < argc)
+        {
+            ++i;
+            runSym  = !strcmp(argv[i], "sym");
+            runHash = !strcmp(argv[i], "hash");
+            runRSA  = !strcmp(argv[i], "rsa");
+        }
+        else
+        {
+            printf("Usage: %s [--max-size bytes] [--min-time sec] [--rsa-samples n] [--only sym|hash|rsa]\n", argv[0]);
+            return EXIT_FAILURE;
+        }
+    }
+    if (maxSize > BENCH_MAX_SIZE)
+        maxSize = BENCH_MAX_SIZE;
+    if (nSamples < 1)
+        nSamples = 1;
+
+    printLibInfo();
+
+    try
+    {
+        if (runSym || runHash)
+        {
+            Ipp8u *src = ippsMalloc_8u((int)maxSize);
+            Ipp8u *dst = ippsMalloc_8u((int)maxSize);
+            if (!(src && dst))
+            {
+                ippsFree(src);
+                ippsFree(dst);
+                fprintf(stderr, "Can't allocate %zu bytes\n", maxSize);
+                return EXIT_FAILURE;
+            }
+            for (size_t n = 0; n < maxSize; ++n)
+                src[n] = n * 31 + 7;
+
+            if (runSym)
+            {
+                benchSymmetric(src, dst, maxSize);
+                printf("%s\n", BENCH_SEPARATOR);
+            }
+            if (runHash)
+            {
+                benchHash(src, maxSize);
+                printf("%s\n", BENCH_SEPARATOR);
+            }
+
+            ippsFree(src);
+            ippsFree(dst);
+        }
+
+        if (runRSA)
+        {
+            benchRSA(nSamples);
+            printf("%s\n", BENCH_SEPARATOR);
+        }
+    }
+    catch (const std::exception &e)
+    {
+        fprintf(stderr, "%s\n", e.what());
+        return EXIT_FAILURE;
+    }
+
+    return EXIT_SUCCESS;
+}
@@ -3,6 +3,8 @@
 #include <stdio.h>
 #include <ctime>
 
+#include <omp.h>
+
 #include <ipp.h>
 #include <ippcp.h>
 
@@ -11,6 +13,13 @@
 #define N_TRIAL   10
 #define MAX_TRIAL 25
 
+enum RSA_SIGN_SCHEME
+{
+    RSA_PSS,         // Probabilistic signature scheme (salt length equals digest length)
+    RSA_PKCS1V15,    // PKCS#1 v1.5 deterministic padding
+    RSA_SIGN_SCHEME_MAX
+};
+
 class RSA_Crypt
 {
   public:
@@ -31,6 +40,25 @@ class RSA_Crypt
                              Ipp8u *label = nullptr,
                              int lenlabel = 0);
     IppStatus getKey(int key_type, Ipp8u *key, int keysize);
+    IppStatus sign(const Ipp8u *msg,
+                   int lenmsg,
+                   Ipp8u *signature,
+                   RSA_SIGN_SCHEME scheme = RSA_PSS,
+                   IppHashAlgId hashAlg   = ippHashAlg_SHA256);
+    IppStatus verify(const Ipp8u *msg,
+                     int lenmsg,
+                     const Ipp8u *signature,
+                     bool &valid,
+                     RSA_SIGN_SCHEME scheme = RSA_PSS,
+                     IppHashAlgId hashAlg   = ippHashAlg_SHA256);
+    IppStatus verifyBatch(const Ipp8u *const *msgs,
+                          const int *lenmsgs,
+                          const Ipp8u *const *signatures,
+                          int n,
+                          bool *valid,
+                          RSA_SIGN_SCHEME scheme = RSA_PSS,
+                          IppHashAlgId hashAlg   = ippHashAlg_SHA256,
+                          int nThreads           = 0);
 
 #ifdef _DEBUG
     void printKeys();
@@ -47,6 +75,9 @@ class RSA_Crypt
     IppsPRNGState *pRNG;
     Ipp32u *seed;
     Ipp8u *buffer;
+    Ipp8u *verifyBuffer    = nullptr;    // Per thread scratch for batch verification
+    int verifyBufferSize   = 0;
+    int verifyBufferThread = 0;
     int bitsP, bitsQ;
 
     // Functions
@@ -0,0 +1,61 @@
+#pragma once
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <random>
+#include <stdexcept>
+
+#include <ipp.h>
+#include <ippcp.h>
+
+#include "asymmetric.h"
+
+/// Envelope magic number ("DPEV")
+#define ENVELOPE_MAGIC 0x56455044
+/// Envelope format version
+#define ENVELOPE_VERSION 1
+/// Size of the per message AES key in bytes (AES-256)
+#define ENVELOPE_KEY_SIZE 32
+/// Size of the GCM initialization vector in bytes
+#define ENVELOPE_IV_SIZE 12
+/// Size of the GCM authentication tag in bytes
+#define ENVELOPE_TAG_SIZE 16
+/// Size of the fixed header in bytes (magic, version, flags, wrapped key length, payload length, IV)
+#define ENVELOPE_HEADER_SIZE 28
+/// Maximum number of bytes passed to a single GCM call
+#define ENVELOPE_CHUNK_SIZE (1 << 30)
+/// Maximum payload of a single envelope (GCM limit for 96-bit IV)
+#define ENVELOPE_MAX_PAYLOAD ((Ipp64u(1) << 36) - 32)
+
+/// Returned when the authentication tag of an envelope does not match
+#define CRYPT_AUTH_ERR ((IppStatus)-2000)
+
+/**
+ * Hybrid encryption. Every message gets a fresh random AES-256 key which is wrapped once with RSA-OAEP, the payload
+ * itself is encrypted with AES-GCM. The fixed header and the wrapped key are authenticated as additional data.
+ *
+ * Layout: | header (28 B) | wrapped key (bitsize / 8) | ciphertext | tag (16 B) |
+ *
+ * Not thread safe, the RSA context is shared. Use one object per thread.
+ */
+class Envelope_Crypt
+{
+  public:
+    Envelope_Crypt(RSA_Crypt &rsa);
+    size_t getSealedSize(size_t lenmsg) const;
+    IppStatus getPayloadSize(const Ipp8u *envelope, size_t lenenv, size_t &lenmsg) const;
+    IppStatus seal(const Ipp8u *msg, size_t lenmsg, Ipp8u *envelope, size_t &lenenv);
+    IppStatus open(const Ipp8u *envelope, size_t lenenv, Ipp8u *msg, size_t &lenmsg);
+    ~Envelope_Crypt();
+
+  private:
+    RSA_Crypt &rsa;
+    IppsAES_GCMState *gcm = nullptr;
+    IppsPRNGState *pRNG   = nullptr;
+    int gcmSize           = 0;
+
+    IppStatus randomBytes(Ipp8u *out, int len);
+    inline void wipe(void *ptr, size_t len);
+};
@@ -0,0 +1,163 @@
+#pragma once
+
+#include <inttypes.h>
+
+#include <list>
+#include <memory>
+#include <mutex>
+#include <stdexcept>
+#include <unordered_map>
+
+#include "symmetric.h"
+
+/// Default number of expanded keys kept by the cache
+#define KEYCACHE_DEFAULT_CAPACITY 1024
+
+/**
+ * Bounded, thread-safe LRU cache of expanded symmetric key contexts keyed by an user supplied key ID.
+ *
+ * Contexts are handed out as shared pointers. An evicted context stays valid until its last user releases it, then
+ * the cipher destructor overwrites the key schedule. Key expansion runs outside of the lock so concurrent misses on
+ * different keys do not serialize. Shared contexts must be used with an explicit counter (ctr parameter of
+ * encryptMessage/decryptMessage) since the internal counter is not synchronized.
+ *
+ * @tparam Cipher AES_Crypt or SMS4_Crypt
+ */
+template <class Cipher>
+class Symmetric_KeyCache
+{
+  public:
+    Symmetric_KeyCache(size_t capacity = KEYCACHE_DEFAULT_CAPACITY) : capacity(capacity ? capacity : 1)
+    {
+    }
+
+    /// Returns cached context or nullptr, marks entry as most recently used
+    std::shared_ptr<Cipher> get(uint64_t keyId)
+    {
+        std::lock_guard<std::mutex> guard(this->lock);
+
+        auto it = this->index.find(keyId);
+        if (it == this->index.end())
+        {
+            ++this->nMiss;
+            return nullptr;
+        }
+
+        ++this->nHit;
+        this->lru.splice(this->lru.begin(), this->lru, it->second);
+        return it->second->second;
+    }
+
+    /**
+     * @brief               Expands and inserts key, replaces existing entry with the same ID
+     *
+     * @param keyId         User supplied key ID
+     * @param key           Key bytes, a random key is never generated here
+     * @param keyBits       Key length in bits, e.g. 256 for AES-256, as taken by the Cipher constructor
+     * @return std::shared_ptr<Cipher> Cached context
+     */
+    std::shared_ptr<Cipher> put(uint64_t keyId, const Ipp8u *key, size_t keyBits)
+    {
+        if (!key)
+            throw std::invalid_argument("Key cache needs the key bytes");
+
+        std::shared_ptr<Cipher> ctx = std::make_shared<Cipher>(const_cast<Ipp8u *>(key), keyBits);
+
+        std::lock_guard<std::mutex> guard(this->lock);
+        this->insert(keyId, ctx, true);
+        return ctx;
+    }
+
+    /// Returns cached context, expands and inserts key on miss, parameters as for put
+    std::shared_ptr<Cipher> acquire(uint64_t keyId, const Ipp8u *key, size_t keyBits)
+    {
+        if (!key)
+            throw std::invalid_argument("Key cache needs the key bytes");
+
+        std::shared_ptr<Cipher> ctx = this->get(keyId);
+        if (ctx)
+            return ctx;
+
+        ctx = std::make_shared<Cipher>(const_cast<Ipp8u *>(key), keyBits);
+
+        // Another thread may have expanded the same key meanwhile, keep the first one
+        std::lock_guard<std::mutex> guard(this->lock);
+        return this->insert(keyId, ctx, false);
+    }
+
+    /// Removes entry, returns false if key ID is not cached
+    bool erase(uint64_t keyId)
+    {
+        std::lock_guard<std::mutex> guard(this->lock);
+
+        auto it = this->index.find(keyId);
+        if (it == this->index.end())
+            return false;
+
+        this->lru.erase(it->second);
+        this->index.erase(it);
+        return true;
+    }
+
+    /// Removes all entries
+    void clear()
+    {
+        std::lock_guard<std::mutex> guard(this->lock);
+
+        this->lru.clear();
+        this->index.clear();
+    }
+
+    size_t size()
+    {
+        std::lock_guard<std::mutex> guard(this->lock);
+        return this->lru.size();
+    }
+
+    /// Number of cache hits and misses since construction
+    void getStats(uint64_t &hit, uint64_t &miss)
+    {
+        std::lock_guard<std::mutex> guard(this->lock);
+        hit  = this->nHit;
+        miss = this->nMiss;
+    }
+
+    ~Symmetric_KeyCache() = default;
+
+  private:
+    typedef std::list<std::pair<uint64_t, std::shared_ptr<Cipher>>> LRUList;
+
+    const size_t capacity;
+    std::mutex lock;
+    LRUList lru;
+    std::unordered_map<uint64_t, typename LRUList::iterator> index;
+    uint64_t nHit  = 0;
+    uint64_t nMiss = 0;
+
+    // Must be called with lock held
+    std::shared_ptr<Cipher> insert(uint64_t keyId, std::shared_ptr<Cipher> &ctx, bool replace)
+    {
+        auto it = this->index.find(keyId);
+        if (it != this->index.end())
+        {
+            this->lru.splice(this->lru.begin(), this->lru, it->second);
+            if (replace)
+                it->second->second = ctx;
+            return it->second->second;
+        }
+
+        // Evict least recently used, context is wiped when its last user releases it
+        while (this->lru.size() >= this->capacity)
+        {
+            this->index.erase(this->lru.back().first);
+            this->lru.pop_back();
+        }
+
+        this->lru.emplace_front(keyId, ctx);
+        this->index.emplace(keyId, this->lru.begin());
+        return ctx;
+    }
+};
+
+typedef Symmetric_KeyCache<AES_Crypt> AES_KeyCache;
+typedef Symmetric_KeyCache<SMS4_Crypt> SMS4_KeyCache;
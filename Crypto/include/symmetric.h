@@ -19,12 +19,13 @@
 
 class AES_Crypt
 {
+  public:
     AES_Crypt(Ipp8u *pkey = nullptr, size_t keyLen = 256);
     IppStatus setKey(const Ipp8u *key, size_t keyLen);
     IppStatus resetCtr(Ipp8u *ctr = nullptr, int ctrBitLen = 0);
     IppStatus encryptMessage(const Ipp8u *msg, int lenmsg, Ipp8u *ciphertext, Ipp8u *ctr = nullptr, int ctrBitLen = 0);
     IppStatus decryptMessage(const Ipp8u *ciphertext, Ipp8u *msg, int &lenmsg, Ipp8u *ctr = nullptr, int ctrBitLen = 0);
-    ~AES_Crypt() = default;
+    ~AES_Crypt();
 
   private:
     size_t keyLen    = 0;
@@ -36,6 +37,7 @@ class AES_Crypt
 
 class SMS4_Crypt
 {
+  public:
     // Functions
     SMS4_Crypt(Ipp8u *pkey = nullptr, size_t keyLen = 256);
     IppStatus setKey(const Ipp8u *key, size_t keyLen);
@@ -531,6 +531,173 @@ IppStatus RSA_Crypt::getKey(int key_type, Ipp8u *key, int keysize)
     return ippStsNoErr;
 }
 
+static inline int hashDigestLen(IppHashAlgId hashAlg)
+{
+    switch (hashAlg)
+    {
+        case ippHashAlg_SHA1:
+            return 20;
+        case ippHashAlg_SHA224:
+        case ippHashAlg_SHA512_224:
+            return 28;
+        case ippHashAlg_SHA256:
+        case ippHashAlg_SHA512_256:
+        case ippHashAlg_SM3:
+            return 32;
+        case ippHashAlg_SHA384:
+            return 48;
+        case ippHashAlg_SHA512:
+            return 64;
+        case ippHashAlg_MD5:
+            return 16;
+        default:
+            return 0;
+    }
+}
+
+IppStatus RSA_Crypt::sign(const Ipp8u *msg, int lenmsg, Ipp8u *signature, RSA_SIGN_SCHEME scheme, IppHashAlgId hashAlg)
+{
+    if (this->privateKey == nullptr)
+        return ippStsContextMatchErr;
+
+    switch (scheme)
+    {
+        case RSA_PSS:
+            {
+                IppStatus status  = ippStsNoErr;
+                const int lensalt = hashDigestLen(hashAlg);
+                Ipp32u salt[64 / 4];
+
+                if (!lensalt)
+                    return ippStsNotSupportedModeErr;
+                if ((status = ippsPRNGen(salt, lensalt * 8, this->pRNG)))
+                    return status;
+
+                // Public key (if exists) is used by IPP to protect against faults in the CRT computation
+                return ippsRSASign_PSS(msg,
+                                       lenmsg,
+                                       (Ipp8u *)salt,
+                                       lensalt,
+                                       signature,
+                                       this->privateKey,
+                                       this->publicKey,
+                                       hashAlg,
+                                       this->buffer);
+            }
+        case RSA_PKCS1V15:
+            return ippsRSASign_PKCS1v15(msg,
+                                        lenmsg,
+                                        signature,
+                                        this->privateKey,
+                                        this->publicKey,
+                                        hashAlg,
+                                        this->buffer);
+        default:
+            return ippStsNotSupportedModeErr;
+    }
+}
+
+IppStatus RSA_Crypt::verify(const Ipp8u *msg,
+                            int lenmsg,
+                            const Ipp8u *signature,
+                            bool &valid,
+                            RSA_SIGN_SCHEME scheme,
+                            IppHashAlgId hashAlg)
+{
+    IppStatus status = ippStsNoErr;
+    int isValid      = 0;
+
+    if (this->publicKey == nullptr)
+        return ippStsContextMatchErr;
+
+    switch (scheme)
+    {
+        case RSA_PSS:
+            status = ippsRSAVerify_PSS(msg, lenmsg, signature, &isValid, this->publicKey, hashAlg, this->buffer);
+            break;
+        case RSA_PKCS1V15:
+            status = ippsRSAVerify_PKCS1v15(msg, lenmsg, signature, &isValid, this->publicKey, hashAlg, this->buffer);
+            break;
+        default:
+            return ippStsNotSupportedModeErr;
+    }
+
+    valid = (status == ippStsNoErr) && isValid;
+    return status;
+}
+
+IppStatus RSA_Crypt::verifyBatch(const Ipp8u *const *msgs,
+                                 const int *lenmsgs,
+                                 const Ipp8u *const *signatures,
+                                 int n,
+                                 bool *valid,
+                                 RSA_SIGN_SCHEME scheme,
+                                 IppHashAlgId hashAlg,
+                                 int nThreads)
+{
+    IppStatus status = ippStsNoErr;
+
+    if (this->publicKey == nullptr)
+        return ippStsContextMatchErr;
+    if (!(msgs && lenmsgs && signatures && valid))
+        return ippStsNullPtrErr;
+    if (scheme != RSA_PSS && scheme != RSA_PKCS1V15)
+        return ippStsNotSupportedModeErr;
+    if (nThreads <= 0)
+        nThreads = omp_get_max_threads();
+
+    // Scratch buffers are kept between calls, public key state is shared read-only
+    if (!this->verifyBufferSize)
+    {
+        if ((status = ippsRSA_GetBufferSizePublicKey(&this->verifyBufferSize, this->publicKey)))
+            return status;
+        this->verifyBufferSize = (this->verifyBufferSize + 63) & ~63;    // Avoid false sharing
+    }
+    if (this->verifyBufferThread < nThreads)
+    {
+        // ippsMalloc_8u aligns to 64 bytes, the rounded slices then start on their own cache lines
+        ippsFree(this->verifyBuffer);
+        this->verifyBuffer       = ippsMalloc_8u(this->verifyBufferSize * nThreads);
+        this->verifyBufferThread = this->verifyBuffer ? nThreads : 0;
+        if (!this->verifyBuffer)
+            return ippStsMemAllocErr;
+    }
+
+#pragma omp parallel for num_threads(nThreads) schedule(dynamic, 64)
+    for (int i = 0; i < n; ++i)
+    {
+        Ipp8u *pBuffer         = &this->verifyBuffer[(size_t)this->verifyBufferSize * omp_get_thread_num()];
+        IppStatus status_local = ippStsNoErr;
+        int isValid            = 0;
+
+        if (scheme == RSA_PSS)
+            status_local = ippsRSAVerify_PSS(msgs[i],
+                                             lenmsgs[i],
+                                             signatures[i],
+                                             &isValid,
+                                             this->publicKey,
+                                             hashAlg,
+                                             pBuffer);
+        else
+            status_local = ippsRSAVerify_PKCS1v15(msgs[i],
+                                                  lenmsgs[i],
+                                                  signatures[i],
+                                                  &isValid,
+                                                  this->publicKey,
+                                                  hashAlg,
+                                                  pBuffer);
+
+        valid[i] = (status_local == ippStsNoErr) && isValid;
+        if (status_local)
+        {
+#pragma omp critical
+            status = status_local;
+        }
+    }
+
+    return status;
+}
+
 RSA_Crypt::~RSA_Crypt()
 {
     int ctxSize;
@@ -557,6 +724,7 @@ RSA_Crypt::~RSA_Crypt()
     }
 
     delete[](Ipp8u *) this->buffer;
+    ippsFree(this->verifyBuffer);
     delete[](Ipp8u *) this->pPG;
     delete[](Ipp8u *) this->pRNG;
     delete[] this->seed;
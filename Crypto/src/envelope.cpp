@@ -0,0 +1,269 @@
+#include "envelope.h"
+
+static inline void store16(Ipp8u *ptr, Ipp16u value)
+{
+    ptr[0] = value & 0xff;
+    ptr[1] = value >> 8;
+}
+
+static inline void store32(Ipp8u *ptr, Ipp32u value)
+{
+    for (int n = 0; n < 4; ++n)
+        ptr[n] = (value >> (8 * n)) & 0xff;
+}
+
+static inline void store64(Ipp8u *ptr, Ipp64u value)
+{
+    for (int n = 0; n < 8; ++n)
+        ptr[n] = (value >> (8 * n)) & 0xff;
+}
+
+static inline Ipp16u load16(const Ipp8u *ptr)
+{
+    return ptr[0] | (ptr[1] << 8);
+}
+
+static inline Ipp32u load32(const Ipp8u *ptr)
+{
+    Ipp32u value = 0;
+    for (int n = 3; n >= 0; --n)
+        value = (value << 8) | ptr[n];
+    return value;
+}
+
+static inline Ipp64u load64(const Ipp8u *ptr)
+{
+    Ipp64u value = 0;
+    for (int n = 7; n >= 0; --n)
+        value = (value << 8) | ptr[n];
+    return value;
+}
+
+Envelope_Crypt::Envelope_Crypt(RSA_Crypt &rsa) : rsa(rsa)
+{
+    IppStatus status = ippStsNoErr;
+    int ctxSize      = 0;
+
+    // Init GCM context
+    status = ippsAES_GCMGetSize(&this->gcmSize);
+    if (status != ippStsNoErr)
+        throw std::runtime_error(ippGetStatusString(status));
+    this->gcm = (IppsAES_GCMState *)(new Ipp8u[this->gcmSize]);
+
+    // Init random generator, seed from hardware if possible
+    status = ippsPRNGGetSize(&ctxSize);
+    if (status != ippStsNoErr)
+        throw std::runtime_error(ippGetStatusString(status));
+    this->pRNG = (IppsPRNGState *)(new Ipp8u[ctxSize]);
+    status     = ippsPRNGInit(256, this->pRNG);
+    if (status != ippStsNoErr)
+        throw std::runtime_error(ippGetStatusString(status));
+
+    Ipp32u seedData[256 / 32];
+    if (ippsTRNGenRDSEED(seedData, 256, nullptr) != ippStsNoErr)
+    {
+        std::random_device rd;
+        for (size_t n = 0; n < 256 / 32; ++n)
+            seedData[n] = rd();
+    }
+    BigNumber seed(seedData, 256 / 32, IppsBigNumPOS);
+    status = ippsPRNGSetSeed(seed, this->pRNG);
+    wipe(seedData, sizeof(seedData));
+    seed = BigNumber::Zero();
+    if (status != ippStsNoErr)
+        throw std::runtime_error(ippGetStatusString(status));
+}
+
+size_t Envelope_Crypt::getSealedSize(size_t lenmsg) const
+{
+    return ENVELOPE_HEADER_SIZE + this->rsa.bitsize / 8 + lenmsg + ENVELOPE_TAG_SIZE;
+}
+
+IppStatus Envelope_Crypt::getPayloadSize(const Ipp8u *envelope, size_t lenenv, size_t &lenmsg) const
+{
+    if (!envelope)
+        return ippStsNullPtrErr;
+    if (lenenv < ENVELOPE_HEADER_SIZE)
+        return ippStsLengthErr;
+    if (load32(envelope) != ENVELOPE_MAGIC || envelope[4] != ENVELOPE_VERSION)
+        return ippStsContextMatchErr;
+
+    lenmsg = load64(&envelope[8]);
+    if (this->getSealedSize(lenmsg) != lenenv)
+        return ippStsLengthErr;
+
+    return ippStsNoErr;
+}
+
+IppStatus Envelope_Crypt::seal(const Ipp8u *msg, size_t lenmsg, Ipp8u *envelope, size_t &lenenv)
+{
+    IppStatus status   = ippStsNoErr;
+    const int wrapSize = this->rsa.bitsize / 8;
+    Ipp8u key[ENVELOPE_KEY_SIZE];
+
+    if (!envelope || (!msg && lenmsg))
+        return ippStsNullPtrErr;
+    if (lenmsg > ENVELOPE_MAX_PAYLOAD || lenenv < this->getSealedSize(lenmsg))
+        return ippStsLengthErr;
+
+    // Fixed header
+    Ipp8u *iv = &envelope[16];
+    store32(&envelope[0], ENVELOPE_MAGIC);
+    envelope[4] = ENVELOPE_VERSION;
+    envelope[5] = 0;
+    store16(&envelope[6], wrapSize);
+    store64(&envelope[8], lenmsg);
+    if ((status = this->randomBytes(iv, ENVELOPE_IV_SIZE)))
+        return status;
+
+    // Wrap a fresh key
+    if ((status = this->randomBytes(key, ENVELOPE_KEY_SIZE)))
+        return status;
+    status = this->rsa.encryptMessage(key, ENVELOPE_KEY_SIZE, &envelope[ENVELOPE_HEADER_SIZE]);
+    if (status != ippStsNoErr)
+        goto cleanup;
+
+    // Bulk encryption, header and wrapped key are authenticated
+    status = ippsAES_GCMInit(key, ENVELOPE_KEY_SIZE, this->gcm, this->gcmSize);
+    if (status != ippStsNoErr)
+        goto cleanup;
+    status = ippsAES_GCMStart(iv, ENVELOPE_IV_SIZE, envelope, ENVELOPE_HEADER_SIZE + wrapSize, this->gcm);
+    if (status != ippStsNoErr)
+        goto cleanup;
+
+    {
+        const Ipp8u *src = msg;
+        Ipp8u *dst       = &envelope[ENVELOPE_HEADER_SIZE + wrapSize];
+        for (size_t left = lenmsg; left > 0;)
+        {
+            const int len = left > ENVELOPE_CHUNK_SIZE ? ENVELOPE_CHUNK_SIZE : (int)left;
+            if ((status = ippsAES_GCMEncrypt(src, dst, len, this->gcm)))
+                goto cleanup;
+            src += len;
+            dst += len;
+            left -= len;
+        }
+        status = ippsAES_GCMGetTag(dst, ENVELOPE_TAG_SIZE, this->gcm);
+    }
+
+    if (status == ippStsNoErr)
+        lenenv = this->getSealedSize(lenmsg);
+
+cleanup:
+    // Overwrite sensitive data
+    wipe(key, ENVELOPE_KEY_SIZE);
+    ippsAES_GCMInit(nullptr, ENVELOPE_KEY_SIZE, this->gcm, this->gcmSize);
+
+    return status;
+}
+
+IppStatus Envelope_Crypt::open(const Ipp8u *envelope, size_t lenenv, Ipp8u *msg, size_t &lenmsg)
+{
+    IppStatus status   = ippStsNoErr;
+    const int wrapSize = this->rsa.bitsize / 8;
+    size_t lenpayload  = 0;
+    int lenkey         = wrapSize;
+    Ipp8u *key         = nullptr;
+
+    if ((status = this->getPayloadSize(envelope, lenenv, lenpayload)))
+        return status;
+    if (load16(&envelope[6]) != wrapSize)
+        return ippStsContextMatchErr;
+    if (!msg && lenpayload)
+        return ippStsNullPtrErr;
+    if (lenmsg < lenpayload)
+        return ippStsLengthErr;
+
+    // Unwrap key
+    key    = new Ipp8u[wrapSize];
+    status = this->rsa.decryptMessage(&envelope[ENVELOPE_HEADER_SIZE], key, lenkey);
+    if (status != ippStsNoErr)
+        goto cleanup;
+    if (lenkey != ENVELOPE_KEY_SIZE)
+    {
+        status = ippStsContextMatchErr;
+        goto cleanup;
+    }
+
+    status = ippsAES_GCMInit(key, ENVELOPE_KEY_SIZE, this->gcm, this->gcmSize);
+    if (status != ippStsNoErr)
+        goto cleanup;
+    status = ippsAES_GCMStart(&envelope[16], ENVELOPE_IV_SIZE, envelope, ENVELOPE_HEADER_SIZE + wrapSize, this->gcm);
+    if (status != ippStsNoErr)
+        goto cleanup;
+
+    {
+        const Ipp8u *src = &envelope[ENVELOPE_HEADER_SIZE + wrapSize];
+        Ipp8u *dst       = msg;
+        for (size_t left = lenpayload; left > 0;)
+        {
+            const int len = left > ENVELOPE_CHUNK_SIZE ? ENVELOPE_CHUNK_SIZE : (int)left;
+            if ((status = ippsAES_GCMDecrypt(src, dst, len, this->gcm)))
+                goto cleanup;
+            src += len;
+            dst += len;
+            left -= len;
+        }
+
+        // Compare tags in constant time
+        Ipp8u tag[ENVELOPE_TAG_SIZE];
+        Ipp8u diff = 0;
+        if ((status = ippsAES_GCMGetTag(tag, ENVELOPE_TAG_SIZE, this->gcm)))
+            goto cleanup;
+        for (int n = 0; n < ENVELOPE_TAG_SIZE; ++n)
+            diff |= tag[n] ^ src[n];
+        if (diff)
+            status = CRYPT_AUTH_ERR;
+    }
+
+    if (status == ippStsNoErr)
+        lenmsg = lenpayload;
+
+cleanup:
+    // Overwrite sensitive data, never release unauthenticated plaintext
+    if (status != ippStsNoErr && lenpayload)
+        wipe(msg, lenpayload);
+    wipe(key, wrapSize);
+    delete[] key;
+    ippsAES_GCMInit(nullptr, ENVELOPE_KEY_SIZE, this->gcm, this->gcmSize);
+
+    return status;
+}
+
+Envelope_Crypt::~Envelope_Crypt()
+{
+    if (this->gcm != nullptr)
+    {
+        ippsAES_GCMInit(nullptr, ENVELOPE_KEY_SIZE, this->gcm, this->gcmSize);
+        delete[](Ipp8u *) this->gcm;
+        this->gcm = nullptr;
+    }
+
+    delete[](Ipp8u *) this->pRNG;
+}
+
+IppStatus Envelope_Crypt::randomBytes(Ipp8u *out, int len)
+{
+    IppStatus status = ippStsNoErr;
+    Ipp32u buff[(ENVELOPE_KEY_SIZE + 3) / 4];
+
+    while (len > 0)
+    {
+        const int size = len > (int)sizeof(buff) ? (int)sizeof(buff) : len;
+        if ((status = ippsPRNGen(buff, size * 8, this->pRNG)))
+            break;
+        memcpy(out, buff, size);
+        out += size;
+        len -= size;
+    }
+    wipe(buff, sizeof(buff));
+
+    return status;
+}
+
+inline void Envelope_Crypt::wipe(void *ptr, size_t len)
+{
+    volatile Ipp8u *p = (volatile Ipp8u *)ptr;
+    while (len--)
+        *p++ = 0;
+}
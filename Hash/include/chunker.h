@@ -0,0 +1,60 @@
+#pragma once
+
+#include <stdint.h>
+#include <stddef.h>
+#include <string.h>
+
+#include <stdexcept>
+#include <vector>
+
+#include <ipp.h>
+
+#define CDC_DEFAULT_AVG 8192       // Expected chunk size, power of two
+#define CDC_MIN_AVG     256
+#define CDC_MAX_AVG     4194304    // 4 MB, mask bits have to fit into the 32-bit fingerprint
+#define CDC_WINDOW      32         // Bytes a 32-bit gear fingerprint depends on
+
+/**
+ * Content-defined chunker, FastCDC style gear hash with normalized chunking.
+ *
+ * fp = (fp << 1) + gear[byte] is a rolling hash of the last 32 bytes. A chunk of n bytes ends at the first byte where
+ * fp & maskS == 0 for minSize <= n < avgSize, or fp & maskL == 0 for avgSize <= n < maxSize, or at n == maxSize. maskS
+ * has two bits more and maskL two bits less than log2(avgSize), which narrows the chunk size distribution. Because
+ * minSize is at least the window, a cut only depends on the 32 bytes before it, so an insertion shifts the boundaries
+ * of the neighbouring chunks only.
+ *
+ * Candidate positions (fp & maskL == 0) are found first, the gear values are looked up with in-register permutes and
+ * the fingerprints of 8 (AVX2) or 16 (AVX-512) consecutive bytes are derived with a prefix scan across lanes, so the
+ * serial dependency is one step per vector instead of one per byte. Cuts are then selected from the sorted candidates
+ * in a short scalar pass. Output is identical to the scalar scan.
+ */
+class CDC_Chunker
+{
+  public:
+    CDC_Chunker(size_t avgSize = CDC_DEFAULT_AVG, size_t minSize = 0, size_t maxSize = 0);
+
+    /**
+     * @brief               Splits data into chunks
+     *
+     * @param data          Pointer to data
+     * @param len           Length of the data
+     * @param final         True if data ends the stream, otherwise the trailing undecided bytes are left unconsumed
+     * @param lengths       Output, chunk lengths are appended
+     * @return size_t       Bytes consumed (sum of the appended lengths), rest has to be passed again with more data
+     */
+    size_t split(const Ipp8u *data, size_t len, bool final, std::vector<size_t> &lengths) const;
+
+    size_t getMinSize() const;
+    size_t getAvgSize() const;
+    size_t getMaxSize() const;
+    ~CDC_Chunker() = default;
+
+  private:
+    size_t minSize;
+    size_t avgSize;
+    size_t maxSize;
+    uint32_t maskS;    // Stricter mask before avgSize
+    uint32_t maskL;    // Looser mask after avgSize, subset of maskS
+
+    void scan(const Ipp8u *data, size_t len, std::vector<uint64_t> &candidates) const;
+};
@@ -0,0 +1,111 @@
+#pragma once
+
+#include <stdio.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include <ipp.h>
+#include <ippcp.h>
+
+#include "chunker.h"
+#include "flatmap.h"
+#include "hasher.h"
+
+#define CDC_DIGEST_SIZE  32            // SHA-256, SM3 or SHA-512/256 fingerprints
+#define CDC_STORE_MAGIC  0x53434443    // "CDCS"
+#define CDC_STREAM_PIECE 67108864      // 64 MB, bytes of a mapped file chunked per step
+
+struct CDC_Fingerprint
+{
+    Ipp8u digest[CDC_DIGEST_SIZE];
+
+    bool operator==(const CDC_Fingerprint &other) const
+    {
+        return !memcmp(this->digest, other.digest, CDC_DIGEST_SIZE);
+    }
+};
+
+/// Fingerprints are uniformly distributed already, the first 8 bytes are a good hash
+class CDC_FingerprintHash
+{
+  public:
+    size_t operator()(const CDC_Fingerprint &fp) const
+    {
+        uint64_t value;
+        memcpy(&value, fp.digest, sizeof(value));
+        return value;
+    }
+};
+
+/**
+ * Deduplicating chunk store.
+ *
+ * Data is split by CDC_Chunker, chunks are fingerprinted in batches with Hash_Coder::hashBatch (multi-buffer SHA-256
+ * where available) and only chunks with an unknown fingerprint are appended to <path>.pack. <path>.idx holds a record
+ * (fingerprint, offset, length) per unique chunk and is loaded into a flat hash map on open. A stored object is
+ * described by its recipe, the list of chunk fingerprints. New index records are written after the pack data they
+ * refer to, so a crash can only leave unreferenced bytes at the end of the pack.
+ */
+class CDC_Store
+{
+  public:
+    struct Stats
+    {
+        Ipp64u logicalBytes;    // Bytes passed to put since open
+        Ipp64u chunks;          // Chunks passed to put since open
+        Ipp64u storedBytes;     // Bytes of unique chunks in the store
+        Ipp64u uniqueChunks;
+    };
+
+    CDC_Store(const char *path, IppHashAlgId id = ippHashAlg_SHA256, size_t avgSize = CDC_DEFAULT_AVG);
+    IppStatus put(const Ipp8u *data, size_t len, std::vector<CDC_Fingerprint> &recipe);
+    IppStatus putFile(const char *path, std::vector<CDC_Fingerprint> &recipe);
+    IppStatus get(const CDC_Fingerprint &fp, std::vector<Ipp8u> &chunk);
+    IppStatus restore(const std::vector<CDC_Fingerprint> &recipe, FILE *out);
+    bool contains(const CDC_Fingerprint &fp) const;
+    IppStatus flush();
+    Stats getStats() const;
+    ~CDC_Store();
+
+  private:
+    struct IndexHeader
+    {
+        Ipp32u magic;
+        Ipp32u id;
+        Ipp32u digestSize;
+        Ipp32u reserved;
+    };
+
+    struct IndexRecord
+    {
+        CDC_Fingerprint fp;
+        Ipp64u offset;
+        Ipp64u length;
+    };
+
+    struct Location
+    {
+        Ipp64u offset;
+        Ipp64u length;
+    };
+
+    CDC_Chunker chunker;
+    IppHashAlgId id;
+    FILE *pack  = nullptr;
+    FILE *index = nullptr;
+    Ipp64u packSize;
+    bool packDirty = false;    // Pack has buffered writes not visible to pread yet
+    Flat_HashMap<CDC_Fingerprint, Location, CDC_FingerprintHash> locations;
+    std::vector<IndexRecord> pending;    // Index records not written yet
+    Stats stats;
+
+    IppStatus openIndex(const std::string &path);
+    IppStatus storeChunks(const Ipp8u *data, const std::vector<size_t> &lengths, std::vector<CDC_Fingerprint> &recipe);
+};
@@ -1,8 +1,16 @@
 #pragma once
 
 #include <string>
+#include <string_view>
 #include <inttypes.h>
+#include <string.h>
 #include <nmmintrin.h>
+#include <wmmintrin.h>
+
+#define CRC32C_POLY      0x82f63b78                // Bit reflected Castagnoli polynomial
+#define CRC_BLOCK_LARGE  4096                      // Bytes per stream of the three way interleaved kernel
+#define CRC_BLOCK_SMALL  256                       // Bytes per stream for the remainder
+#define CRC_PARALLEL_MIN (3 * CRC_BLOCK_SMALL)    // Shorter inputs use a single dependency chain
 
 /**
  * @brief               Computes CRC32 hash using intrinsic functions
@@ -13,6 +21,26 @@
  */
 uint64_t crc(const char *buff, size_t len);
 
+/**
+ * @brief               Continues a CRC32 computation, crc_update(crc(A), B, lenB) == crc(A | B)
+ *
+ * @param state         CRC of the preceding data (0 for the first chunk)
+ * @param buff          Pointer to data buff
+ * @param len           Length of the data
+ * @return uint64_t     Updated CRC32 hash
+ */
+uint64_t crc_update(uint64_t state, const char *buff, size_t len);
+
+/**
+ * @brief               Combines CRCs of two consecutive chunks, crc_combine(crc(A), crc(B), lenB) == crc(A | B)
+ *
+ * @param crcA          CRC of the first chunk
+ * @param crcB          CRC of the second chunk (computed from state 0)
+ * @param lenB          Length of the second chunk
+ * @return uint64_t     CRC32 hash of the concatenation
+ */
+uint64_t crc_combine(uint64_t crcA, uint64_t crcB, size_t lenB);
+
 class CRCHashFunction
 {
 public:
@@ -21,8 +49,19 @@ public:
         return crc(p.c_str(), p.size());
     }
 
+    size_t operator()(std::string_view p) const
+    {
+        return crc(p.data(), p.size());
+    }
+
+    /// String literals and C strings, would be ambiguous between the std::string and std::string_view overloads
+    size_t operator()(const char *p) const
+    {
+        return crc(p, strlen(p));
+    }
+
     size_t operator()(const void *p, size_t len) const
     {
-        return crc(p, len);
+        return crc((const char *)p, len);
     }
 };
\ No newline at end of file
@@ -0,0 +1,88 @@
+#pragma once
+
+#include <stdint.h>
+#include <stddef.h>
+#include <string.h>
+
+#include <string>
+#include <string_view>
+
+#define FASTHASH_SHORT  16     // Inputs up to this size are mixed directly
+#define FASTHASH_MEDIUM 256    // Up to this size a three lane multiply-fold loop is used, longer inputs are striped
+#define FASTHASH_STRIPE 64     // Bytes per stripe, one 64-bit lane per accumulator
+#define FASTHASH_BLOCK  1024   // Stripes per accumulator scramble * FASTHASH_STRIPE
+
+struct FastHash128
+{
+    uint64_t lo;
+    uint64_t hi;
+
+    bool operator==(const FastHash128 &other) const
+    {
+        return this->lo == other.lo && this->hi == other.hi;
+    }
+};
+
+/**
+ * @brief               Computes 64-bit non-cryptographic hash with full avalanche
+ *
+ * Short inputs use 64x64->128 bit multiply folding (wyhash style), long inputs are accumulated in 64 byte stripes
+ * into eight independent lanes (XXH3 style). The AVX2 kernel produces the same value as the scalar one.
+ *
+ * @param data          Pointer to data
+ * @param len           Length of the data
+ * @param seed          Seed, different seeds give independent hash functions
+ * @return uint64_t     Calculated hash
+ */
+uint64_t fasthash64(const void *data, size_t len, uint64_t seed = 0);
+
+/**
+ * @brief               Computes 128-bit non-cryptographic hash, low half is not equal to fasthash64
+ *
+ * @param data          Pointer to data
+ * @param len           Length of the data
+ * @param seed          Seed
+ * @return FastHash128  Calculated hash
+ */
+FastHash128 fasthash128(const void *data, size_t len, uint64_t seed = 0);
+
+/**
+ * @brief               Mixes a 64-bit integer key into a well distributed hash
+ *
+ * @param key           Key
+ * @param seed          Seed
+ * @return uint64_t     Calculated hash
+ */
+uint64_t fasthash64_u64(uint64_t key, uint64_t seed = 0);
+
+/// Hash functor for unordered containers, Flat_HashMap and sketches, drop in replacement of CRCHashFunction
+class FastHashFunction
+{
+  public:
+    FastHashFunction(uint64_t seed = 0) : seed(seed)
+    {
+    }
+
+    size_t operator()(const std::string &p) const
+    {
+        return fasthash64(p.data(), p.size(), this->seed);
+    }
+
+    size_t operator()(std::string_view p) const
+    {
+        return fasthash64(p.data(), p.size(), this->seed);
+    }
+
+    size_t operator()(const void *p, size_t len) const
+    {
+        return fasthash64(p, len, this->seed);
+    }
+
+    size_t operator()(uint64_t key) const
+    {
+        return fasthash64_u64(key, this->seed);
+    }
+
+  private:
+    uint64_t seed;
+};
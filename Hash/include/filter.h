@@ -0,0 +1,150 @@
+#pragma once
+
+#include <stdint.h>
+#include <stddef.h>
+
+#include <stdexcept>
+
+#include "fasthash.h"
+
+#define FILTER_MAGIC       0x544c4946    // "FILT"
+#define FILTER_HEADER_SIZE 64            // Filter data in saved files starts cache line aligned
+#define FILTER_BATCH       16            // Lookups prefetched ahead in containsBatch
+#define BLOOM_DEFAULT_FPR  0.01
+#define BLOOM_BLOCK_WORDS  8             // 256-bit blocks, one bit per 32-bit word is set for each key
+#define CUCKOO_DEFAULT_FPR 0.001
+#define CUCKOO_MAX_KICKS   500           // Relocations before an insert gives up
+
+/*
+ * Both filters take the key as a well mixed 64-bit hash, fasthash64 is used for the byte key overloads. A crc()
+ * value has only 32 bits, it has to be spread with fasthash64_u64 first and its collisions add about n / 2^32 to the
+ * false positive rate, which matters with hundreds of millions of keys.
+ *
+ * Saved filters are a 64 byte header followed by the raw table. Opening maps the file copy-on-write, so a filter is
+ * usable without reading it and later inserts do not modify the file until it is saved again. Saving writes a new file
+ * renamed over the old one, so a mapped filter can be saved to the path it was opened from.
+ */
+
+/**
+ * Split block Bloom filter.
+ *
+ * The upper 32 hash bits select a 256-bit block, the lower 32 bits multiplied by eight odd salts select one bit in
+ * each of the block's 32-bit words. A lookup touches a single aligned block, never more than one cache line, and is a
+ * single AVX2 test of the block against the key mask. The number of blocks is derived from the expected number of
+ * keys and the target false positive rate.
+ */
+class Bloom_Filter
+{
+  public:
+    Bloom_Filter(size_t capacity, double fpr = BLOOM_DEFAULT_FPR);
+    explicit Bloom_Filter(const char *path);
+    Bloom_Filter(const Bloom_Filter &)            = delete;
+    Bloom_Filter &operator=(const Bloom_Filter &) = delete;
+
+    void insert(uint64_t hash);
+    bool contains(uint64_t hash) const;
+
+    void insert(const void *key, size_t len)
+    {
+        this->insert(fasthash64(key, len));
+    }
+
+    bool contains(const void *key, size_t len) const
+    {
+        return this->contains(fasthash64(key, len));
+    }
+
+    /**
+     * @brief               Looks up n hashes, blocks of the following keys are prefetched
+     *
+     * @param hashes        Key hashes
+     * @param n             Number of hashes
+     * @param result        Output, false if the key is definitely not present
+     */
+    void containsBatch(const uint64_t *hashes, size_t n, bool *result) const;
+
+    bool save(const char *path) const;
+    void clear();
+    size_t getCount() const;
+    size_t getSizeBytes() const;
+    double getFpr() const;    // Expected false positive rate at the current count
+    ~Bloom_Filter();
+
+  private:
+    uint32_t *blocks = nullptr;
+    size_t nBlocks;
+    size_t count;            // Inserts, duplicates included
+    void *map      = nullptr;
+    size_t mapSize = 0;      // Mapped file size, zero if blocks are allocated
+
+    inline size_t blockIndex(uint64_t hash) const;
+};
+
+/**
+ * Cuckoo filter with deletion.
+ *
+ * Every bucket is a 64-bit word holding 8 tags of 8 bits, 4 of 16 bits or 2 of 32 bits, the smallest tag size which
+ * reaches the target false positive rate (about 2 * slots / 2^bits) is used. A key lives in one of two buckets,
+ * i2 = i1 ^ H(tag), so a tag can be relocated without the key. Bucket lookups compare all tags in one word (SWAR) and
+ * batch lookups prefetch both buckets of the following keys. When an insert fails after CUCKOO_MAX_KICKS relocations
+ * the homeless tag is kept aside and the filter reports full for further inserts.
+ */
+class Cuckoo_Filter
+{
+  public:
+    Cuckoo_Filter(size_t capacity, double fpr = CUCKOO_DEFAULT_FPR);
+    explicit Cuckoo_Filter(const char *path);
+    Cuckoo_Filter(const Cuckoo_Filter &)            = delete;
+    Cuckoo_Filter &operator=(const Cuckoo_Filter &) = delete;
+
+    bool insert(uint64_t hash);    // False if the filter is full
+    bool contains(uint64_t hash) const;
+    bool erase(uint64_t hash);     // Only keys which were inserted may be erased
+
+    bool insert(const void *key, size_t len)
+    {
+        return this->insert(fasthash64(key, len));
+    }
+
+    bool contains(const void *key, size_t len) const
+    {
+        return this->contains(fasthash64(key, len));
+    }
+
+    bool erase(const void *key, size_t len)
+    {
+        return this->erase(fasthash64(key, len));
+    }
+
+    void containsBatch(const uint64_t *hashes, size_t n, bool *result) const;
+
+    bool save(const char *path) const;
+    void clear();
+    size_t getCount() const;
+    size_t getCapacity() const;    // Total tag slots
+    int getTagBits() const;
+    size_t getSizeBytes() const;
+    ~Cuckoo_Filter();
+
+  private:
+    uint64_t *buckets = nullptr;
+    size_t nBuckets;    // Power of two
+    int tagBits;
+    int slots;          // Tags per bucket
+    uint64_t ones;      // 1 in the lowest bit of every lane
+    uint64_t highs;     // 1 in the highest bit of every lane
+    size_t count;
+    bool hasVictim;
+    size_t victimIndex;
+    uint64_t victimTag;
+    uint64_t rng;
+    void *map      = nullptr;
+    size_t mapSize = 0;
+
+    void init(size_t nBuckets, int tagBits);
+    inline uint64_t tag(uint64_t hash) const;
+    inline size_t altIndex(size_t index, uint64_t tag) const;
+    inline uint64_t matchLanes(uint64_t bucket, uint64_t tag) const;
+    inline bool tryInsert(size_t index, uint64_t tag);
+    void place(size_t index, uint64_t tag);    // Inserts with relocations, keeps the last homeless tag aside
+};
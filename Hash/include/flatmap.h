@@ -0,0 +1,533 @@
+#pragma once
+
+#include <stdlib.h>
+#include <string.h>
+#include <inttypes.h>
+#include <emmintrin.h>
+
+#include <new>
+#include <string>
+#include <string_view>
+#include <tuple>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+#include "crc.h"
+
+#define FLATMAP_GROUP_WIDTH  16        // Control bytes probed by a single SSE2 compare
+#define FLATMAP_MIN_CAPACITY 16
+#define FLATMAP_ARENA_BLOCK  1048576    // 1 MB key storage blocks
+#define FLATMAP_BATCH        16         // Lookups prefetched ahead in findBatch
+
+/**
+ * Open addressing hash map with the Swiss table layout.
+ *
+ * Every slot has a control byte, either EMPTY, DELETED or the 7 low bits (H2) of the hash of a stored key. Slots are
+ * organized in aligned groups of 16. A lookup compares H2 with the whole control group in one SSE2 instruction and
+ * only touches the keys of matching slots, so a miss rarely reads a key at all. Groups are probed in triangular order,
+ * the search stops at the first group with an EMPTY byte. The table grows at 7/8 load, erasing leaves a tombstone only
+ * if the group is full and the slot might lie on another key's probe path.
+ *
+ * Keys and values are stored inline in a single array, there is no per-insert allocation. Pointers returned by find
+ * and insert are invalidated by any insertion that grows or rehashes the table.
+ *
+ * @tparam Key      Key type, lookups take any type that Hash accepts without conversion and operator== compares
+ *                  with Key, e.g. std::string_view or C strings with CRCHashFunction
+ * @tparam Value    Mapped type
+ * @tparam Hash     Hash functor, CRCHashFunction hashes strings with the SSE4.2 CRC32 instruction
+ */
+template <class Key, class Value, class Hash = CRCHashFunction>
+class Flat_HashMap
+{
+  public:
+    typedef std::pair<Key, Value> Slot;
+
+    Flat_HashMap(size_t capacity = 0, const Hash &hasher = Hash()) : hasher(hasher)
+    {
+        if (capacity)
+            this->reserve(capacity);
+    }
+
+    Flat_HashMap(const Flat_HashMap &) = delete;
+    Flat_HashMap &operator=(const Flat_HashMap &) = delete;
+
+    /// Returns pointer to the mapped value or nullptr
+    template <class K>
+    Value *find(const K &key)
+    {
+        const size_t index = this->findIndex(key, this->hashKey(key));
+        return index == NOT_FOUND ? nullptr : &this->slots[index].second;
+    }
+
+    template <class K>
+    const Value *find(const K &key) const
+    {
+        const size_t index = this->findIndex(key, this->hashKey(key));
+        return index == NOT_FOUND ? nullptr : &this->slots[index].second;
+    }
+
+    template <class K>
+    bool contains(const K &key) const
+    {
+        return this->find(key) != nullptr;
+    }
+
+    /**
+     * @brief               Looks up n keys, hashes and control groups of the following keys are prefetched
+     *
+     * @param keys          Keys to look up
+     * @param n             Number of keys
+     * @param values        Output, pointer to the mapped value or nullptr for each key
+     */
+    template <class K>
+    void findBatch(const K *keys, size_t n, Value **values)
+    {
+        this->lookupBatch(keys, n, values);
+    }
+
+    template <class K>
+    void findBatch(const K *keys, size_t n, const Value **values) const
+    {
+        this->lookupBatch(keys, n, values);
+    }
+
+    /// Inserts key if not present, returns mapped value and true if inserted
+    template <class K, class V>
+    std::pair<Value *, bool> insert(K &&key, V &&value)
+    {
+        return this->emplaceWith(key, [&](Slot *slot) {
+            new (slot) Slot(std::forward<K>(key), std::forward<V>(value));
+        });
+    }
+
+    /// Inserts or overwrites, returns true if key was new
+    template <class K, class V>
+    bool insertOrAssign(K &&key, V &&value)
+    {
+        // Value is consumed by exactly one of insert (new key) or the assignment
+        std::pair<Value *, bool> res = this->insert(std::forward<K>(key), std::forward<V>(value));
+        if (!res.second)
+            *res.first = std::forward<V>(value);
+        return res.second;
+    }
+
+    template <class K>
+    Value &operator[](K &&key)
+    {
+        return *this->emplaceWith(key, [&](Slot *slot) {
+                        new (slot) Slot(std::piecewise_construct,
+                                        std::forward_as_tuple(std::forward<K>(key)),
+                                        std::forward_as_tuple());
+                    }).first;
+    }
+
+    /// Removes key, returns false if it was not present
+    template <class K>
+    bool erase(const K &key)
+    {
+        const size_t index = this->findIndex(key, this->hashKey(key));
+        if (index == NOT_FOUND)
+            return false;
+
+        this->slots[index].~Slot();
+        --this->count;
+
+        // No probe ever passed a group that still has an EMPTY byte, the slot can be freed without a tombstone
+        const size_t group = index & ~(size_t)(FLATMAP_GROUP_WIDTH - 1);
+        if (this->matchEmpty(group))
+        {
+            this->ctrl[index] = CTRL_EMPTY;
+            ++this->growthLeft;
+        }
+        else
+            this->ctrl[index] = CTRL_DELETED;
+
+        return true;
+    }
+
+    /// Calls func(key, value) for every entry, order is unspecified
+    template <class Func>
+    void forEach(Func func) const
+    {
+        for (size_t group = 0; group < this->capacity; group += FLATMAP_GROUP_WIDTH)
+        {
+            for (uint32_t mask = this->matchFull(group); mask; mask &= mask - 1)
+            {
+                Slot &slot = this->slots[group + __builtin_ctz(mask)];
+                func(slot.first, slot.second);
+            }
+        }
+    }
+
+    /// Makes room for n entries without further rehashing
+    void reserve(size_t n)
+    {
+        size_t capacity = FLATMAP_MIN_CAPACITY;
+        while (capacity - capacity / 8 < n)
+            capacity *= 2;
+        if (capacity > this->capacity)
+            this->rehash(capacity);
+    }
+
+    void clear()
+    {
+        this->destroySlots();
+        if (this->capacity)
+            memset(this->ctrl, CTRL_EMPTY, this->capacity);
+        this->count      = 0;
+        this->growthLeft = this->maxLoad(this->capacity);
+    }
+
+    size_t size() const
+    {
+        return this->count;
+    }
+
+    size_t getCapacity() const
+    {
+        return this->capacity;
+    }
+
+    bool empty() const
+    {
+        return this->count == 0;
+    }
+
+    ~Flat_HashMap()
+    {
+        this->destroySlots();
+        free(this->ctrl);
+        ::operator delete(this->slots);
+    }
+
+  protected:
+    /// Finds key or claims a free slot for it, make(slot) constructs the entry in the claimed slot
+    template <class K, class Make>
+    std::pair<Value *, bool> emplaceWith(const K &key, Make make)
+    {
+        const size_t hash = this->hashKey(key);
+        size_t index      = this->findIndex(key, hash);
+        if (index != NOT_FOUND)
+            return {&this->slots[index].second, false};
+
+        if (!this->capacity)
+            this->rehash(FLATMAP_MIN_CAPACITY);
+
+        index = this->findFree(hash);
+        if (this->ctrl[index] == CTRL_EMPTY && this->growthLeft == 0)
+        {
+            // Mostly tombstones, rebuild in place; otherwise double
+            this->rehash(this->count < this->maxLoad(this->capacity) / 2 ? this->capacity : 2 * this->capacity);
+            index = this->findFree(hash);
+        }
+
+        make(&this->slots[index]);
+        if (this->ctrl[index] == CTRL_EMPTY)
+            --this->growthLeft;
+        this->ctrl[index] = h2(hash);
+        ++this->count;
+
+        return {&this->slots[index].second, true};
+    }
+
+  private:
+    static const int8_t CTRL_EMPTY   = -128;    // 0x80
+    static const int8_t CTRL_DELETED = -2;      // 0xfe, full slots are 0x00 - 0x7f
+    static const size_t NOT_FOUND    = ~(size_t)0;
+
+    int8_t *ctrl      = nullptr;
+    Slot *slots       = nullptr;
+    size_t capacity   = 0;    // Power of two, multiple of the group width
+    size_t count      = 0;
+    size_t growthLeft = 0;    // EMPTY slots that can be used before the table has to grow
+    Hash hasher;
+
+    static size_t maxLoad(size_t capacity)
+    {
+        return capacity - capacity / 8;
+    }
+
+    template <class K>
+    size_t hashKey(const K &key) const
+    {
+        // Spread 32-bit CRC over 64 bits, top bits feed the group index, low 7 bits are the control byte
+        return (uint64_t)this->hasher(key) * 0x9e3779b97f4a7c15ull;
+    }
+
+    static int8_t h2(size_t hash)
+    {
+        return (int8_t)(hash & 0x7f);
+    }
+
+    size_t probeStart(size_t hash) const
+    {
+        return (size_t)(hash >> 32 ^ hash >> 7) & (this->capacity - 1) & ~(size_t)(FLATMAP_GROUP_WIDTH - 1);
+    }
+
+    uint32_t match(size_t group, int8_t value) const
+    {
+        const __m128i ctrl = _mm_load_si128((const __m128i *)&this->ctrl[group]);
+        return _mm_movemask_epi8(_mm_cmpeq_epi8(ctrl, _mm_set1_epi8(value)));
+    }
+
+    uint32_t matchEmpty(size_t group) const
+    {
+        return this->match(group, CTRL_EMPTY);
+    }
+
+    /// EMPTY and DELETED have the sign bit set
+    uint32_t matchFree(size_t group) const
+    {
+        return _mm_movemask_epi8(_mm_load_si128((const __m128i *)&this->ctrl[group]));
+    }
+
+    uint32_t matchFull(size_t group) const
+    {
+        return ~this->matchFree(group) & 0xffff;
+    }
+
+    /// Shared by both findBatch overloads, V is Value or const Value
+    template <class K, class V>
+    void lookupBatch(const K *keys, size_t n, V **values) const
+    {
+        size_t hashes[FLATMAP_BATCH];
+
+        for (size_t base = 0; base < n; base += FLATMAP_BATCH)
+        {
+            const size_t count = n - base < FLATMAP_BATCH ? n - base : FLATMAP_BATCH;
+
+            for (size_t k = 0; k < count; ++k)
+            {
+                hashes[k] = this->hashKey(keys[base + k]);
+                if (this->capacity)
+                    _mm_prefetch((const char *)&this->ctrl[this->probeStart(hashes[k])], _MM_HINT_T0);
+            }
+            for (size_t k = 0; k < count; ++k)
+            {
+                const size_t index = this->findIndex(keys[base + k], hashes[k]);
+                values[base + k]   = index == NOT_FOUND ? nullptr : &this->slots[index].second;
+            }
+        }
+    }
+
+    template <class K>
+    size_t findIndex(const K &key, size_t hash) const
+    {
+        if (!this->capacity)
+            return NOT_FOUND;
+
+        const size_t mask = this->capacity - 1;
+        size_t group      = this->probeStart(hash);
+
+        // Triangular probing over a power of two number of groups visits every group once
+        for (size_t step = FLATMAP_GROUP_WIDTH; step <= this->capacity; step += FLATMAP_GROUP_WIDTH)
+        {
+            for (uint32_t bits = this->match(group, h2(hash)); bits; bits &= bits - 1)
+            {
+                const size_t index = group + __builtin_ctz(bits);
+                if (this->slots[index].first == key)
+                    return index;
+            }
+            if (this->matchEmpty(group))
+                return NOT_FOUND;
+            group = (group + step) & mask;
+        }
+
+        return NOT_FOUND;
+    }
+
+    /// First EMPTY or DELETED slot on the probe path, the table always has one since load is capped at 7/8
+    size_t findFree(size_t hash) const
+    {
+        const size_t mask = this->capacity - 1;
+        size_t group      = this->probeStart(hash);
+
+        for (size_t step = FLATMAP_GROUP_WIDTH;; step += FLATMAP_GROUP_WIDTH)
+        {
+            const uint32_t bits = this->matchFree(group);
+            if (bits)
+                return group + __builtin_ctz(bits);
+            group = (group + step) & mask;
+        }
+    }
+
+    void rehash(size_t newCapacity)
+    {
+        int8_t *oldCtrl     = this->ctrl;
+        Slot *oldSlots      = this->slots;
+        const size_t oldCap = this->capacity;
+        void *ctrl          = nullptr;
+
+        if (posix_memalign(&ctrl, FLATMAP_GROUP_WIDTH, newCapacity))
+            throw std::bad_alloc();
+        this->slots = (Slot *)::operator new(newCapacity * sizeof(Slot));
+        this->ctrl  = (int8_t *)ctrl;
+        memset(this->ctrl, CTRL_EMPTY, newCapacity);
+        this->capacity   = newCapacity;
+        this->growthLeft = maxLoad(newCapacity) - this->count;
+
+        // Fresh table has no tombstones, entries go to the first free slot of their probe path
+        for (size_t index = 0; index < oldCap; ++index)
+        {
+            if (oldCtrl[index] < 0)
+                continue;
+
+            Slot &slot          = oldSlots[index];
+            const size_t hash   = this->hashKey(slot.first);
+            const size_t target = this->findFree(hash);
+            new (&this->slots[target]) Slot(std::move(slot));
+            this->ctrl[target] = h2(hash);
+            slot.~Slot();
+        }
+
+        free(oldCtrl);
+        ::operator delete(oldSlots);
+    }
+
+    void destroySlots()
+    {
+        if (std::is_trivially_destructible<Slot>::value)
+            return;
+        for (size_t index = 0; index < this->capacity; ++index)
+        {
+            if (this->ctrl[index] >= 0)
+                this->slots[index].~Slot();
+        }
+    }
+};
+
+/**
+ * Append only storage for string keys.
+ *
+ * Keys are copied into large blocks so a map of short strings does not pay one heap allocation and the std::string
+ * header per entry. Stored views stay valid until the arena is cleared or destroyed, erased keys are not reclaimed.
+ */
+class String_Arena
+{
+  public:
+    String_Arena(size_t blockSize = FLATMAP_ARENA_BLOCK) : blockSize(blockSize ? blockSize : FLATMAP_ARENA_BLOCK)
+    {
+    }
+
+    String_Arena(const String_Arena &) = delete;
+    String_Arena &operator=(const String_Arena &) = delete;
+
+    std::string_view store(std::string_view key)
+    {
+        if (key.size() > this->left)
+        {
+            // Oversized keys get their own block, the current block keeps serving short keys
+            const size_t size = key.size() > this->blockSize ? key.size() : this->blockSize;
+            char *block       = (char *)malloc(size ? size : 1);
+            if (!block)
+                throw std::bad_alloc();
+            this->blocks.push_back(block);
+            if (size == this->blockSize)
+            {
+                this->next = block;
+                this->left = size;
+            }
+            else
+            {
+                memcpy(block, key.data(), key.size());
+                this->used += key.size();
+                return std::string_view(block, key.size());
+            }
+        }
+
+        char *dst = this->next;
+        memcpy(dst, key.data(), key.size());
+        this->next += key.size();
+        this->left -= key.size();
+        this->used += key.size();
+
+        return std::string_view(dst, key.size());
+    }
+
+    /// Key bytes stored so far
+    size_t getUsed() const
+    {
+        return this->used;
+    }
+
+    void clear()
+    {
+        for (char *block : this->blocks)
+            free(block);
+        this->blocks.clear();
+        this->next = nullptr;
+        this->left = 0;
+        this->used = 0;
+    }
+
+    ~String_Arena()
+    {
+        this->clear();
+    }
+
+  private:
+    std::vector<char *> blocks;
+    size_t blockSize;
+    char *next  = nullptr;
+    size_t left = 0;
+    size_t used = 0;
+};
+
+/**
+ * Flat map with string keys interned in a String_Arena.
+ *
+ * Lookups take any string type, the key bytes are copied into the arena only when a new entry is inserted.
+ *
+ * @tparam Value    Mapped type
+ */
+template <class Value>
+class Flat_StringMap : public Flat_HashMap<std::string_view, Value, CRCHashFunction>
+{
+  public:
+    typedef Flat_HashMap<std::string_view, Value, CRCHashFunction> Base;
+
+    Flat_StringMap(size_t capacity = 0, size_t arenaBlock = FLATMAP_ARENA_BLOCK) : Base(capacity), arena(arenaBlock)
+    {
+    }
+
+    template <class V>
+    std::pair<Value *, bool> insert(std::string_view key, V &&value)
+    {
+        return this->emplaceWith(key, [&](typename Base::Slot *slot) {
+            new (slot) typename Base::Slot(this->arena.store(key), std::forward<V>(value));
+        });
+    }
+
+    template <class V>
+    bool insertOrAssign(std::string_view key, V &&value)
+    {
+        std::pair<Value *, bool> res = this->insert(key, std::forward<V>(value));
+        if (!res.second)
+            *res.first = std::forward<V>(value);
+        return res.second;
+    }
+
+    Value &operator[](std::string_view key)
+    {
+        return *this->emplaceWith(key, [&](typename Base::Slot *slot) {
+                        new (slot) typename Base::Slot(std::piecewise_construct,
+                                                       std::forward_as_tuple(this->arena.store(key)),
+                                                       std::forward_as_tuple());
+                    }).first;
+    }
+
+    void clear()
+    {
+        Base::clear();
+        this->arena.clear();
+    }
+
+    const String_Arena &getArena() const
+    {
+        return this->arena;
+    }
+
+  private:
+    String_Arena arena;
+};
@@ -1,12 +1,28 @@
 #pragma once
 
 #include <stdio.h>
+#include <stdlib.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
 #include <stdexcept>
+#include <vector>
+
+#include <omp.h>
 
 #include <ipp.h>
 #include <ippcp.h>
 
+#include "sha256mb.h"
+
 #define MAX_HASH_MSG_LEN 65534
+#define HASH_MMAP_CHUNK  67108864    // 64 MB, bytes fed per update while hashing a mapped file
+#define HASH_READ_SIZE   8388608     //  8 MB, read size if file can not be mapped
+#define HASH_READ_ALIGN  4096
+#define HASH_UPDATE_MAX  1073741824  //  1 GB, ippsHashUpdate takes an int length, longer messages are fed in pieces
+#define HMAC_BLOCK_MAX   128         // SHA-384/512 family, 64 bytes for the other algorithms
 
 class Hash_Coder
 {
@@ -14,9 +30,45 @@ class Hash_Coder
     Hash_Coder(IppHashAlgId id);
     IppStatus update(Ipp8u *msg, size_t lenmsg);
     IppStatus calcFileHash(FILE *fptr, Ipp8u *hashCode);
+    IppStatus hashFile(const char *path, Ipp8u *hashCode);
     IppStatus getHash(Ipp8u *code);
+    int getDigestSize() const;
+    static int getDigestSize(IppHashAlgId id);
+    static IppStatus hashBatch(IppHashAlgId id, const Ipp8u *const *msgs, const size_t *lens, size_t n, Ipp8u *digests);
     ~Hash_Coder();
 
   private:
+    IppHashAlgId id        = ippHashAlg_Unknown;
     IppsHashState *context = nullptr;
-};
\ No newline at end of file
+};
+
+/**
+ * HMAC (RFC 2104) with precomputed key states.
+ *
+ * The hash states after absorbing key ^ ipad and key ^ opad are computed once per key and duplicated for every
+ * message, so a MAC costs the message blocks plus a single outer block instead of two extra key blocks.
+ */
+class Hmac_Coder
+{
+  public:
+    Hmac_Coder(IppHashAlgId id, const Ipp8u *key, size_t keyLen);
+    IppStatus setKey(const Ipp8u *key, size_t keyLen);
+    IppStatus update(const Ipp8u *msg, size_t lenmsg);
+    IppStatus getMac(Ipp8u *mac);
+    IppStatus calcMac(const Ipp8u *msg, size_t lenmsg, Ipp8u *mac);
+    IppStatus verify(const Ipp8u *msg, size_t lenmsg, const Ipp8u *mac, size_t lenmac, bool &valid);
+    IppStatus calcMacBatch(const Ipp8u *const *msgs, const size_t *lens, size_t n, Ipp8u *macs, int nThreads = 0);
+    int getMacSize() const;
+    static int getBlockSize(IppHashAlgId id);
+    ~Hmac_Coder();
+
+  private:
+    IppHashAlgId id      = ippHashAlg_Unknown;
+    int ctxSize          = 0;
+    int macSize          = 0;
+    IppsHashState *inner = nullptr;    // State after key ^ ipad
+    IppsHashState *outer = nullptr;    // State after key ^ opad
+    IppsHashState *work  = nullptr;    // Streaming state, always continues from inner
+
+    IppStatus finish(IppsHashState *state, Ipp8u *mac) const;
+};
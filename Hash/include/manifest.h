@@ -0,0 +1,125 @@
+#pragma once
+
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+#include <sys/stat.h>
+
+#include <algorithm>
+#include <filesystem>
+#include <memory>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include <omp.h>
+
+#include <ipp.h>
+#include <ippcp.h>
+
+#include "fasthash.h"
+#include "flatmap.h"
+#include "hasher.h"
+
+#define MANIFEST_CACHE_MAGIC 0x48434e4d     // "MNCH"
+#define MANIFEST_RACY_NS     1000000000    // Files modified this close to the scan start are not cached
+
+/**
+ * Integrity manifest of a directory tree.
+ *
+ * The tree is walked once for metadata, then the files are hashed in parallel with one Hash_Coder per thread, largest
+ * files first. A persistent cache maps (device, inode, size, mtime) to the digest of the last run, files with an
+ * unchanged key are not read at all. Like git's index, files whose mtime is not safely older than the scan start are
+ * never cached, a write within the timestamp granularity would otherwise go unnoticed. Files changed while hashed are
+ * not cached either.
+ *
+ * The manifest lists regular files sorted by path relative to the root in the sha256sum format, so two manifests can
+ * be compared with diff and a manifest can be checked with the coreutils tools. Symbolic links are not followed.
+ */
+class Manifest_Builder
+{
+  public:
+    struct Entry
+    {
+        std::string path;    // Relative to the root
+        Ipp64u size;
+        Ipp64s mtimeNs;
+        Ipp64u dev;
+        Ipp64u inode;
+        IppStatus status;    // Hashing result, entries with an error are left out of the manifest
+        bool cacheable;
+    };
+
+    struct Stats
+    {
+        size_t files;
+        size_t cached;         // Digests taken from the cache
+        size_t hashed;
+        size_t failed;         // Unreadable files and directories
+        Ipp64u bytesHashed;
+    };
+
+    Manifest_Builder(IppHashAlgId id, int nThreads = 0);
+
+    /**
+     * @brief               Walks the tree and computes the digests of all regular files
+     *
+     * @param root          Root directory
+     * @param cachePath     Hash cache, read if it exists and replaced with the current files, nullptr for no cache
+     * @return IppStatus    ippStsNoOperation if root can not be opened, failures of single files or directories are
+     *                      only counted, the rest of the tree is still processed
+     */
+    IppStatus build(const char *root, const char *cachePath = nullptr);
+    IppStatus write(FILE *out) const;
+    IppStatus write(const char *path) const;
+    const std::vector<Entry> &getEntries() const;
+    const Ipp8u *getDigest(size_t index) const;
+    Stats getStats() const;
+    ~Manifest_Builder() = default;
+
+  private:
+    struct CacheKey
+    {
+        Ipp64u dev;
+        Ipp64u inode;
+        Ipp64u size;
+        Ipp64s mtimeNs;
+
+        bool operator==(const CacheKey &other) const
+        {
+            return !memcmp(this, &other, sizeof(CacheKey));
+        }
+    };
+
+    class CacheKeyHash
+    {
+      public:
+        size_t operator()(const CacheKey &key) const
+        {
+            return fasthash64(&key, sizeof(key));
+        }
+    };
+
+    struct CacheHeader
+    {
+        Ipp32u magic;
+        Ipp32u id;
+        Ipp32u digestSize;
+        Ipp32u reserved;
+        Ipp64u count;
+    };
+
+    IppHashAlgId id;
+    int nThreads;
+    int digestSize;
+    std::vector<std::unique_ptr<Hash_Coder>> coders;    // One context per thread
+    std::filesystem::path root;
+    std::vector<Entry> entries;
+    std::vector<Ipp8u> digests;    // digestSize bytes per entry
+    Stats stats;
+
+    void walk();
+    void readCache(const char *cachePath);
+    IppStatus writeCache(const char *cachePath, Ipp64s startNs) const;
+    static CacheKey cacheKey(const Entry &entry);
+};
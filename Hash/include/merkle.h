@@ -0,0 +1,69 @@
+#pragma once
+
+#include <stdio.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include <memory>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include <omp.h>
+
+#include <ipp.h>
+#include <ippcp.h>
+
+#include "hasher.h"
+
+#define MERKLE_DEFAULT_CHUNK 4194304       // 4 MB leaves
+#define MERKLE_MAX_CHUNK     1073741824    // 1 GB, single update length is limited to int
+#define MERKLE_LEAF_MAGIC    0x4c4b524d    // "MRKL"
+#define MERKLE_LEAF_PREFIX   0x00          // Domain separation of leaf and inner nodes
+#define MERKLE_NODE_PREFIX   0x01
+
+/**
+ * Tree hash of a file with fixed size leaf chunks.
+ *
+ * leaf = H(0x00 | chunk), node = H(0x01 | left | right). An odd node at the end of a level is promoted as is.
+ * Leaves are hashed in parallel with one Hash_Coder per thread. Leaf hashes can be saved to a side file so a single
+ * chunk can be verified or refreshed later without rehashing the whole file.
+ */
+class Merkle_Hasher
+{
+  public:
+    Merkle_Hasher(IppHashAlgId id, size_t chunkSize = MERKLE_DEFAULT_CHUNK, int nThreads = 0);
+    IppStatus hashFile(const char *path, Ipp8u *root, const char *leafPath = nullptr);
+    IppStatus verifyChunks(const char *path,
+                           const char *leafPath,
+                           const std::vector<size_t> &indices,
+                           std::vector<size_t> &changed);
+    IppStatus updateChunks(const char *path, const char *leafPath, const std::vector<size_t> &indices, Ipp8u *root);
+    IppStatus calcRoot(const Ipp8u *leaves, size_t nLeaves, Ipp8u *root);
+    int getDigestSize() const;
+    ~Merkle_Hasher() = default;
+
+  private:
+    struct LeafHeader
+    {
+        Ipp32u magic;
+        Ipp32u id;
+        Ipp64u chunkSize;
+        Ipp64u fileSize;
+        Ipp64u nLeaves;
+    };
+
+    IppHashAlgId id;
+    size_t chunkSize;
+    int nThreads;
+    int digestSize;
+    std::vector<std::unique_ptr<Hash_Coder>> coders;    // One context per thread
+
+    IppStatus hashChunks(const Ipp8u *data, size_t dataLen, const size_t *indices, size_t count, Ipp8u *leaves);
+    IppStatus readLeaves(const char *leafPath, LeafHeader &header, std::vector<Ipp8u> &leaves);
+    IppStatus writeLeaves(const char *leafPath, const LeafHeader &header, const Ipp8u *leaves);
+    inline size_t countLeaves(size_t fileSize) const;
+};
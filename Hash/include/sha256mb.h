@@ -0,0 +1,27 @@
+#pragma once
+
+#include <stdint.h>
+#include <stddef.h>
+#include <string.h>
+
+#define SHA256_MB_DIGEST_SIZE 32
+#define SHA256_MB_BLOCK_SIZE  64
+
+/**
+ * @brief               Number of SIMD lanes of the best multi-buffer SHA-256 kernel on this CPU
+ *
+ * @return int          16 (AVX-512), 8 (AVX2) or 0 if no multi-buffer kernel is usable or the CPU has SHA
+ *                      extensions, which hash a single stream faster
+ */
+int sha256_mb_lanes();
+
+/**
+ * @brief               Computes SHA-256 of n independent messages, interleaving one message per SIMD lane
+ *
+ * @param msgs          Message pointers
+ * @param lens          Message lengths in bytes
+ * @param n             Number of messages
+ * @param digests       Output, n * SHA256_MB_DIGEST_SIZE bytes
+ * @return int          Number of lanes used, 0 if no kernel is usable (nothing is written)
+ */
+int sha256_mb(const uint8_t *const *msgs, const size_t *lens, size_t n, uint8_t *digests);
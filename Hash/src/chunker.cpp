@@ -0,0 +1,274 @@
+#include "chunker.h"
+
+#include <immintrin.h>
+
+/// Gear value of a byte is a tabulation hash of its bit groups 0-2, 3-5 and 6-7, SIMD kernels look it up with permutes
+static const uint32_t GEAR_A[8] = {
+    0x63cfc62a, 0xdc0746b4, 0x08264674, 0x3ca4eb47, 0xa5b384ad, 0x08f720d0, 0xfe6675c9, 0x1d59c7b9};
+static const uint32_t GEAR_B[8] = {
+    0xea5685b6, 0x3935c47e, 0xf72314ef, 0xe2c2311b, 0x509d7011, 0x4cd89b95, 0xa4e38806, 0x5a469fb3};
+static const uint32_t GEAR_C[8] = {
+    0x5087cfea, 0x76efeb82, 0xa21f9904, 0xd3cf31c5, 0x5087cfea, 0x76efeb82, 0xa21f9904, 0xd3cf31c5};
+
+static const struct GearTable
+{
+    uint32_t gear[256];
+    GearTable()
+    {
+        for (int b = 0; b < 256; ++b)
+            gear[b] = GEAR_A[b & 7] ^ GEAR_B[(b >> 3) & 7] ^ GEAR_C[b >> 6];
+    }
+} GEAR;
+
+/// Candidates are encoded as (position << 1) | (fp & maskS == 0)
+static inline void scanScalar(const Ipp8u *data,
+                              size_t begin,
+                              size_t end,
+                              uint32_t fp,
+                              uint32_t maskS,
+                              uint32_t maskL,
+                              std::vector<uint64_t> &candidates)
+{
+    for (size_t j = begin; j < end; ++j)
+    {
+        fp = (fp << 1) + GEAR.gear[data[j]];
+        if (!(fp & maskL))
+            candidates.push_back((uint64_t)j << 1 | !(fp & maskS));
+    }
+}
+
+/// Fingerprint of the window ending right before pos
+static inline uint32_t warmUp(const Ipp8u *data, size_t pos)
+{
+    uint32_t fp = 0;
+    for (size_t j = pos >= CDC_WINDOW - 1 ? pos - (CDC_WINDOW - 1) : 0; j < pos; ++j)
+        fp = (fp << 1) + GEAR.gear[data[j]];
+    return fp;
+}
+
+/*
+ * SIMD kernels compute the fingerprints of N consecutive positions at once. With g the gear values of the block and
+ * c the fingerprint before it, fp[i] = (c << (i + 1)) + sum(g[t] << (i - t), t <= i). The sum is a prefix scan done in
+ * log2(N) shift-and-add steps across lanes.
+ */
+
+__attribute__((target("avx2"))) static inline __m256i gear8(__m256i b)
+{
+    const __m256i a = _mm256_permutevar8x32_epi32(_mm256_loadu_si256((const __m256i *)GEAR_A), b);
+    const __m256i m = _mm256_permutevar8x32_epi32(_mm256_loadu_si256((const __m256i *)GEAR_B), _mm256_srli_epi32(b, 3));
+    const __m256i c = _mm256_permutevar8x32_epi32(_mm256_loadu_si256((const __m256i *)GEAR_C), _mm256_srli_epi32(b, 6));
+    return _mm256_xor_si256(_mm256_xor_si256(a, m), c);
+}
+
+__attribute__((target("avx2"))) static void scanAvx2(const Ipp8u *data,
+                                                     size_t begin,
+                                                     size_t end,
+                                                     uint32_t maskS,
+                                                     uint32_t maskL,
+                                                     std::vector<uint64_t> &candidates)
+{
+    const __m256i shifts = _mm256_setr_epi32(1, 2, 3, 4, 5, 6, 7, 8);
+    const __m256i idx1   = _mm256_setr_epi32(0, 0, 1, 2, 3, 4, 5, 6);
+    const __m256i idx2   = _mm256_setr_epi32(0, 0, 0, 1, 2, 3, 4, 5);
+    const __m256i idx4   = _mm256_setr_epi32(0, 0, 0, 0, 0, 1, 2, 3);
+    const __m256i keep1  = _mm256_setr_epi32(0, -1, -1, -1, -1, -1, -1, -1);
+    const __m256i keep2  = _mm256_setr_epi32(0, 0, -1, -1, -1, -1, -1, -1);
+    const __m256i keep4  = _mm256_setr_epi32(0, 0, 0, 0, -1, -1, -1, -1);
+    const __m256i last   = _mm256_set1_epi32(7);
+    const __m256i vMaskL = _mm256_set1_epi32(maskL);
+    __m256i carry        = _mm256_set1_epi32(warmUp(data, begin));
+    alignas(32) uint32_t fps[8];
+    size_t j = begin;
+
+    for (; j + 8 <= end; j += 8)
+    {
+        __m256i g = gear8(_mm256_cvtepu8_epi32(_mm_loadl_epi64((const __m128i *)(data + j))));
+        g = _mm256_add_epi32(g, _mm256_and_si256(_mm256_slli_epi32(_mm256_permutevar8x32_epi32(g, idx1), 1), keep1));
+        g = _mm256_add_epi32(g, _mm256_and_si256(_mm256_slli_epi32(_mm256_permutevar8x32_epi32(g, idx2), 2), keep2));
+        g = _mm256_add_epi32(g, _mm256_and_si256(_mm256_slli_epi32(_mm256_permutevar8x32_epi32(g, idx4), 4), keep4));
+
+        const __m256i fp = _mm256_add_epi32(g, _mm256_sllv_epi32(carry, shifts));
+        carry            = _mm256_permutevar8x32_epi32(fp, last);
+
+        const __m256i hit = _mm256_cmpeq_epi32(_mm256_and_si256(fp, vMaskL), _mm256_setzero_si256());
+        int bits          = _mm256_movemask_ps(_mm256_castsi256_ps(hit));
+        if (bits)
+        {    // Rare, one in 2^bitsL positions
+            _mm256_store_si256((__m256i *)fps, fp);
+            for (; bits; bits &= bits - 1)
+            {
+                const int l = __builtin_ctz(bits);
+                candidates.push_back((uint64_t)(j + l) << 1 | !(fps[l] & maskS));
+            }
+        }
+    }
+
+    scanScalar(data, j, end, (uint32_t)_mm256_cvtsi256_si32(carry), maskS, maskL, candidates);
+}
+
+// AVX-512 kernel uses vector extensions for the arithmetic, the unmasked intrinsics trip -Wmaybe-uninitialized
+typedef uint32_t v16u __attribute__((vector_size(64)));
+
+__attribute__((target("avx512f"))) static inline v16u permute16(__mmask16 keep, v16u index, v16u table)
+{
+    return (v16u)_mm512_maskz_permutexvar_epi32(keep, (__m512i)index, (__m512i)table);
+}
+
+/// 8 entry table repeated in both halves, permutes only use the low 3 index bits
+__attribute__((target("avx512f"))) static inline v16u table16(const uint32_t *table)
+{
+    return (v16u)_mm512_maskz_broadcast_i64x4(0xff, _mm256_loadu_si256((const __m256i *)table));
+}
+
+__attribute__((target("avx512f"))) static inline v16u gear16(v16u b)
+{
+    const v16u a = permute16(0xffff, b & 7, table16(GEAR_A));
+    const v16u m = permute16(0xffff, (b >> 3) & 7, table16(GEAR_B));
+    const v16u c = permute16(0xffff, b >> 6, table16(GEAR_C));
+    return a ^ m ^ c;
+}
+
+__attribute__((target("avx512f"))) static void scanAvx512(const Ipp8u *data,
+                                                          size_t begin,
+                                                          size_t end,
+                                                          uint32_t maskS,
+                                                          uint32_t maskL,
+                                                          std::vector<uint64_t> &candidates)
+{
+    const v16u lane   = {0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14, 15};
+    const v16u shifts = lane + 1;
+    const v16u last   = lane * 0 + 15;
+    v16u carry        = lane * 0 + warmUp(data, begin);
+    alignas(64) uint32_t fps[16];
+    size_t j = begin;
+
+    for (; j + 16 <= end; j += 16)
+    {
+        v16u g = gear16((v16u)_mm512_maskz_cvtepu8_epi32(0xffff, _mm_loadu_si128((const __m128i *)(data + j))));
+
+        // Lanes below k have no predecessor at distance k
+        g += permute16(0xfffe, lane - 1, g) << 1;
+        g += permute16(0xfffc, lane - 2, g) << 2;
+        g += permute16(0xfff0, lane - 4, g) << 4;
+        g += permute16(0xff00, lane - 8, g) << 8;
+
+        const v16u fp = g + (carry << shifts);
+        carry         = permute16(0xffff, last, fp);
+
+        __mmask16 bits = _mm512_testn_epi32_mask((__m512i)fp, _mm512_set1_epi32(maskL));
+        if (bits)
+        {
+            memcpy(fps, &fp, sizeof(fps));
+            for (unsigned int b = bits; b; b &= b - 1)
+            {
+                const int l = __builtin_ctz(b);
+                candidates.push_back((uint64_t)(j + l) << 1 | !(fps[l] & maskS));
+            }
+        }
+    }
+
+    scanScalar(data, j, end, carry[0], maskS, maskL, candidates);
+}
+
+CDC_Chunker::CDC_Chunker(size_t avgSize, size_t minSize, size_t maxSize)
+{
+    if (avgSize < CDC_MIN_AVG || avgSize > CDC_MAX_AVG || (avgSize & (avgSize - 1)))
+        throw std::invalid_argument("Average chunk size has to be a power of two between 256 B and 4 MB");
+
+    this->avgSize = avgSize;
+    this->minSize = minSize ? minSize : avgSize / 4;
+    this->maxSize = maxSize ? maxSize : avgSize * 8;
+    if (this->minSize < CDC_WINDOW || this->minSize > this->avgSize || this->maxSize < this->avgSize)
+        throw std::invalid_argument("Invalid chunk size limits");
+
+    // Normalization level 2, mask bits spread over the upper part of the fingerprint which depends on more bytes
+    const int bits  = __builtin_ctzll(avgSize);
+    const int bitsS = bits + 2;
+    const int bitsL = bits - 2;
+    const int step  = bitsS <= 16 ? 2 : 1;
+
+    this->maskS = this->maskL = 0;
+    for (int i = 0; i < bitsS; ++i)
+    {
+        this->maskS |= 1u << (31 - i * step);
+        if (i < bitsL)
+            this->maskL |= 1u << (31 - i * step);
+    }
+}
+
+size_t CDC_Chunker::split(const Ipp8u *data, size_t len, bool final, std::vector<size_t> &lengths) const
+{
+    std::vector<uint64_t> candidates;
+    size_t start = 0, ci = 0;
+
+    if (!data || !len)
+        return 0;
+    this->scan(data, len, candidates);
+
+    const size_t nCand = candidates.size();
+    while (start < len)
+    {
+        size_t cut = len;
+
+        // Skip candidates closer than minSize to the chunk start
+        while (ci < nCand && (candidates[ci] >> 1) < start + this->minSize - 1)
+            ++ci;
+
+        // Strict mask below avgSize, loose mask below maxSize
+        size_t k = ci;
+        for (; k < nCand && (candidates[k] >> 1) < start + this->avgSize - 1; ++k)
+        {
+            if (candidates[k] & 1)
+            {
+                cut = candidates[k] >> 1;
+                break;
+            }
+        }
+        if (cut == len && k < nCand && (candidates[k] >> 1) < start + this->maxSize - 1)
+            cut = candidates[k] >> 1;
+
+        if (cut == len)
+        {
+            if (len - start >= this->maxSize)
+                cut = start + this->maxSize - 1;
+            else if (final)
+                cut = len - 1;
+            else
+                break;    // Boundary depends on data not seen yet
+        }
+
+        lengths.push_back(cut - start + 1);
+        start = cut + 1;
+    }
+
+    return start;
+}
+
+size_t CDC_Chunker::getMinSize() const
+{
+    return this->minSize;
+}
+
+size_t CDC_Chunker::getAvgSize() const
+{
+    return this->avgSize;
+}
+
+size_t CDC_Chunker::getMaxSize() const
+{
+    return this->maxSize;
+}
+
+void CDC_Chunker::scan(const Ipp8u *data, size_t len, std::vector<uint64_t> &candidates) const
+{
+    static const bool avx512 = __builtin_cpu_supports("avx512f");
+    static const bool avx2   = __builtin_cpu_supports("avx2");
+
+    candidates.reserve(candidates.size() + (len >> __builtin_popcount(this->maskL)) + 16);
+    if (avx512)
+        scanAvx512(data, 0, len, this->maskS, this->maskL, candidates);
+    else if (avx2)
+        scanAvx2(data, 0, len, this->maskS, this->maskL, candidates);
+    else
+        scanScalar(data, 0, len, 0, this->maskS, this->maskL, candidates);
+}
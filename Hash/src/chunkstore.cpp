@@ -0,0 +1,274 @@
+#include "chunkstore.h"
+
+CDC_Store::CDC_Store(const char *path, IppHashAlgId id, size_t avgSize) : chunker(avgSize)
+{
+    if (Hash_Coder::getDigestSize(id) != CDC_DIGEST_SIZE)
+        throw std::invalid_argument("Chunk fingerprints have to be 32 bytes");
+
+    this->id    = id;
+    this->stats = {0, 0, 0, 0};
+
+    const std::string base(path);
+    this->pack = fopen((base + ".pack").c_str(), "a+b");
+    if (!this->pack)
+        throw std::runtime_error("Can't open chunk pack file");
+    fseeko(this->pack, 0, SEEK_END);
+    this->packSize = ftello(this->pack);
+
+    IppStatus status = this->openIndex(base + ".idx");
+    if (status != ippStsNoErr)
+    {
+        fclose(this->pack);
+        if (this->index)
+            fclose(this->index);
+        throw std::runtime_error(ippGetStatusString(status));
+    }
+}
+
+IppStatus CDC_Store::put(const Ipp8u *data, size_t len, std::vector<CDC_Fingerprint> &recipe)
+{
+    std::vector<size_t> lengths;
+
+    if (!data && len)
+        return ippStsNullPtrErr;
+
+    this->chunker.split(data, len, true, lengths);
+    return this->storeChunks(data, lengths, recipe);
+}
+
+IppStatus CDC_Store::putFile(const char *path, std::vector<CDC_Fingerprint> &recipe)
+{
+    IppStatus status = ippStsNoErr;
+    struct stat info;
+
+    int fd = open(path, O_RDONLY);
+    if (fd < 0)
+        return ippStsNoOperation;
+    if (fstat(fd, &info) || !S_ISREG(info.st_mode))
+    {
+        close(fd);
+        return ippStsNoOperation;
+    }
+
+    const size_t fileSize = info.st_size;
+    if (!fileSize)
+    {
+        close(fd);
+        return ippStsNoErr;
+    }
+
+    Ipp8u *map = (Ipp8u *)mmap(nullptr, fileSize, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (map == MAP_FAILED)
+        return ippStsNoOperation;
+
+    // Chunk in pieces to bound the candidate and fingerprint buffers, undecided tail moves to the next piece
+    const size_t pageMask = (size_t)sysconf(_SC_PAGESIZE) - 1;
+    std::vector<size_t> lengths;
+    size_t offset = 0, released = 0;
+    while (offset < fileSize && !status)
+    {
+        const size_t len = fileSize - offset < CDC_STREAM_PIECE ? fileSize - offset : CDC_STREAM_PIECE;
+        const bool final = offset + len == fileSize;
+
+        // Pieces end at chunk boundaries, readahead and release work on whole pages
+        const size_t next = (offset + len) & ~pageMask;
+        const size_t left = fileSize - next;
+        if (!final && left)
+            madvise(map + next, left < CDC_STREAM_PIECE ? left : CDC_STREAM_PIECE, MADV_WILLNEED);
+
+        lengths.clear();
+        const size_t used = this->chunker.split(map + offset, len, final, lengths);
+        status            = this->storeChunks(map + offset, lengths, recipe);
+        offset += used;
+
+        const size_t done = offset == fileSize ? fileSize : offset & ~pageMask;
+        if (done > released)
+        {
+            madvise(map + released, done - released, MADV_DONTNEED);
+            released = done;
+        }
+    }
+    munmap(map, fileSize);
+
+    return status;
+}
+
+IppStatus CDC_Store::get(const CDC_Fingerprint &fp, std::vector<Ipp8u> &chunk)
+{
+    const Location *loc = this->locations.find(fp);
+    if (!loc)
+        return ippStsOutOfRangeErr;
+
+    if (this->packDirty)
+    {
+        if (fflush(this->pack))
+            return ippStsErr;
+        this->packDirty = false;
+    }
+
+    chunk.resize(loc->length);
+    const ssize_t size = pread(fileno(this->pack), chunk.data(), loc->length, loc->offset);
+    if (size < 0 || (Ipp64u)size != loc->length)
+        return ippStsErr;
+
+    // Detect corruption of the pack before handing data out
+    const Ipp8u *msg = chunk.data();
+    const size_t len = chunk.size();
+    CDC_Fingerprint check;
+    IppStatus status = Hash_Coder::hashBatch(this->id, &msg, &len, 1, check.digest);
+    if (status)
+        return status;
+
+    return check == fp ? ippStsNoErr : ippStsContextMatchErr;
+}
+
+IppStatus CDC_Store::restore(const std::vector<CDC_Fingerprint> &recipe, FILE *out)
+{
+    IppStatus status = ippStsNoErr;
+    std::vector<Ipp8u> chunk;
+
+    if (!out)
+        return ippStsNullPtrErr;
+
+    for (const CDC_Fingerprint &fp : recipe)
+    {
+        if ((status = this->get(fp, chunk)))
+            return status;
+        if (fwrite(chunk.data(), 1, chunk.size(), out) != chunk.size())
+            return ippStsErr;
+    }
+
+    return status;
+}
+
+bool CDC_Store::contains(const CDC_Fingerprint &fp) const
+{
+    return this->locations.contains(fp);
+}
+
+IppStatus CDC_Store::flush()
+{
+    // Pack data first, index records must never point past durable pack data
+    if (fflush(this->pack) || fsync(fileno(this->pack)))
+        return ippStsErr;
+    this->packDirty = false;
+
+    if (this->pending.empty())
+        return ippStsNoErr;
+    const size_t n = this->pending.size();
+    if (fwrite(this->pending.data(), sizeof(IndexRecord), n, this->index) != n || fflush(this->index))
+        return ippStsErr;
+    this->pending.clear();
+
+    return ippStsNoErr;
+}
+
+CDC_Store::Stats CDC_Store::getStats() const
+{
+    return this->stats;
+}
+
+CDC_Store::~CDC_Store()
+{
+    this->flush();
+    fclose(this->index);
+    fclose(this->pack);
+}
+
+IppStatus CDC_Store::openIndex(const std::string &path)
+{
+    IndexHeader header = {CDC_STORE_MAGIC, (Ipp32u)this->id, CDC_DIGEST_SIZE, 0};
+    IndexRecord record;
+
+    this->index = fopen(path.c_str(), "a+b");
+    if (!this->index)
+        return ippStsNoOperation;
+
+    fseeko(this->index, 0, SEEK_END);
+    if (ftello(this->index) == 0)
+    {
+        if (fwrite(&header, sizeof(header), 1, this->index) != 1 || fflush(this->index))
+            return ippStsErr;
+        return ippStsNoErr;
+    }
+
+    IndexHeader stored;
+    fseeko(this->index, 0, SEEK_SET);
+    if (fread(&stored, sizeof(stored), 1, this->index) != 1 || memcmp(&stored, &header, sizeof(header)))
+        return ippStsContextMatchErr;
+
+    // Records are appended after their chunks reached the pack, a record past the pack end or a partial record can
+    // only be the tail of a torn write
+    off_t validEnd = sizeof(header);
+    while (fread(&record, sizeof(record), 1, this->index) == 1 && record.offset + record.length <= this->packSize)
+    {
+        validEnd += sizeof(record);
+        if (this->locations.insert(record.fp, Location{record.offset, record.length}).second)
+        {
+            this->stats.storedBytes += record.length;
+            ++this->stats.uniqueChunks;
+        }
+    }
+
+    // Cut the torn tail off, records appended after it would be misaligned on the next open
+    fseeko(this->index, 0, SEEK_END);
+    if (ftello(this->index) != validEnd)
+    {
+        if (ftruncate(fileno(this->index), validEnd) || fseeko(this->index, 0, SEEK_END))
+            return ippStsErr;
+    }
+
+    return ippStsNoErr;
+}
+
+IppStatus CDC_Store::storeChunks(const Ipp8u *data,
+                                 const std::vector<size_t> &lengths,
+                                 std::vector<CDC_Fingerprint> &recipe)
+{
+    const size_t n = lengths.size();
+    if (!n)
+        return ippStsNoErr;
+
+    std::vector<const Ipp8u *> msgs(n);
+    std::vector<CDC_Fingerprint> fps(n);
+
+    for (size_t k = 0, offset = 0; k < n; offset += lengths[k++])
+        msgs[k] = data + offset;
+
+    IppStatus status = Hash_Coder::hashBatch(this->id, msgs.data(), lengths.data(), n, fps[0].digest);
+    if (status)
+        return status;
+
+    recipe.reserve(recipe.size() + n);
+    for (size_t k = 0; k < n; ++k)
+    {
+        recipe.push_back(fps[k]);
+        this->stats.logicalBytes += lengths[k];
+        ++this->stats.chunks;
+
+        std::pair<Location *, bool> res = this->locations.insert(fps[k], Location{this->packSize, lengths[k]});
+        if (!res.second)
+            continue;    // Duplicate, only referenced
+
+        if (fwrite(msgs[k], 1, lengths[k], this->pack) != lengths[k])
+        {
+            // Part of the chunk may have reached the file, appends have to continue at packSize
+            this->locations.erase(fps[k]);
+            fflush(this->pack);
+            if (ftruncate(fileno(this->pack), this->packSize) || fseeko(this->pack, 0, SEEK_END))
+            {
+                fseeko(this->pack, 0, SEEK_END);
+                this->packSize = ftello(this->pack);    // Can't cut, later chunks are placed after the partial one
+            }
+            return ippStsErr;
+        }
+        this->pending.push_back({fps[k], this->packSize, lengths[k]});
+        this->packSize += lengths[k];
+        this->packDirty = true;
+        this->stats.storedBytes += lengths[k];
+        ++this->stats.uniqueChunks;
+    }
+
+    return ippStsNoErr;
+}
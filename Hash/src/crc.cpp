@@ -48,8 +48,124 @@ uint64_t dword_crc32(uint64_t crc, const char **buf, size_t len)
     return crc;
 }
 
+/// a(x) * b(x) mod P(x) in bit reflected representation (software)
+static uint32_t multmodp(uint32_t a, uint32_t b)
+{
+    uint32_t m = 1u << 31, p = 0;
+
+    if (!a)
+        return 0;    // The loop stops at the lowest set bit of a
+    for (;;)
+    {
+        if (a & m)
+        {
+            p ^= b;
+            if ((a & (m - 1)) == 0)
+                break;
+        }
+        m >>= 1;
+        b = b & 1 ? (b >> 1) ^ CRC32C_POLY : b >> 1;
+    }
+
+    return p;
+}
+
+/// a(x) * b(x) mod P(x) with carry-less multiply, hardware CRC does the 64 to 32 bit reduction
+__attribute__((target("sse4.2,pclmul"))) static uint32_t multmodp_clmul(uint32_t a, uint32_t b)
+{
+    const __m128i prod = _mm_clmulepi64_si128(_mm_cvtsi32_si128(a), _mm_cvtsi32_si128(b), 0x00);
+    const uint64_t res = (uint64_t)_mm_cvtsi128_si64(prod) << 1;    // Reflected product is one bit short
+
+    return _mm_crc32_u32(0, (uint32_t)res) ^ (uint32_t)(res >> 32);
+}
+
+static bool has_clmul()
+{
+    static const bool supported = __builtin_cpu_supports("pclmul");
+    return supported;
+}
+
+static inline uint32_t crc_shift(uint32_t crc, uint32_t xpow)
+{
+    return has_clmul() ? multmodp_clmul(crc, xpow) : multmodp(crc, xpow);
+}
+
+/// x^(8 * len) mod P(x), multiplying a CRC with it appends len zero bytes
+static uint32_t xpow8nmodp(size_t len)
+{
+    // x^(8 * 2^k) mod P(x) for every bit of len
+    static const struct Table
+    {
+        uint32_t pow[64];
+        Table()
+        {
+            pow[0] = 1u << 23;    // x^8
+            for (int k = 1; k < 64; ++k)
+                pow[k] = multmodp(pow[k - 1], pow[k - 1]);
+        }
+    } table;
+
+    uint32_t p = 1u << 31;    // x^0
+    for (int k = 0; len; ++k, len >>= 1)
+    {
+        if (len & 1)
+            p = crc_shift(p, table.pow[k]);
+    }
+
+    return p;
+}
+
+/**
+ * Three independent CRC chains over consecutive segments of 3 * block bytes. The CRC instruction has a latency of
+ * three cycles and a throughput of one per cycle, three chains keep the unit busy. Partial CRCs are merged by
+ * shifting them over the following segments.
+ */
+static uint64_t crc32_3way(uint64_t crc, const char **buf, size_t *len, size_t block, uint32_t k1, uint32_t k2)
+{
+    const size_t words = block / 8;
+
+    while (*len >= 3 * block)
+    {
+        const uint64_t *p0 = (const uint64_t *)(*buf);
+        const uint64_t *p1 = p0 + words;
+        const uint64_t *p2 = p1 + words;
+        uint64_t c0 = crc, c1 = 0, c2 = 0;
+
+        for (size_t i = 0; i < words; ++i)
+        {
+            c0 = _mm_crc32_u64(c0, p0[i]);
+            c1 = _mm_crc32_u64(c1, p1[i]);
+            c2 = _mm_crc32_u64(c2, p2[i]);
+        }
+
+        // crc(A | B | C) = crc(A) * x^(2 * 8 * block) + crc(B) * x^(8 * block) + crc(C)
+        crc = crc_shift(c0, k2) ^ crc_shift(c1, k1) ^ c2;
+        *buf += 3 * block;
+        *len -= 3 * block;
+    }
+
+    return crc;
+}
+
+static uint64_t crc32_parallel(uint64_t crc, const char **buf, size_t *len)
+{
+    static const uint32_t kLarge1 = xpow8nmodp(CRC_BLOCK_LARGE), kLarge2 = xpow8nmodp(2 * CRC_BLOCK_LARGE);
+    static const uint32_t kSmall1 = xpow8nmodp(CRC_BLOCK_SMALL), kSmall2 = xpow8nmodp(2 * CRC_BLOCK_SMALL);
+
+    crc = crc32_3way(crc, buf, len, CRC_BLOCK_LARGE, kLarge1, kLarge2);
+    return crc32_3way(crc, buf, len, CRC_BLOCK_SMALL, kSmall1, kSmall2);
+}
+
 uint64_t crc(const char *buff, size_t len)
 {
+    return crc_update(0, buff, len);
+}
+
+uint64_t crc_update(uint64_t crc, const char *buff, size_t len)
+{
+    if (len >= CRC_PARALLEL_MIN)
+        crc = crc32_parallel(crc, &buff, &len);
+
     const size_t dword_chunks = len / 8;
     const size_t dword_diff = len % 8;
 
@@ -59,10 +175,18 @@ uint64_t crc(const char *buff, size_t len)
     const size_t hw_chunks = word_diff / 2;
     const size_t hw_diff = word_diff % 2;
 
-    uint64_t crc = byte_crc32(0, &buff, hw_diff);
+    crc = byte_crc32(crc, &buff, hw_diff);
     crc = hw_crc32(crc, &buff, hw_chunks);
     crc = word_crc32(crc, &buff, word_chunks);
     crc = dword_crc32(crc, &buff, dword_chunks);
 
     return crc;
+}
+
+uint64_t crc_combine(uint64_t crcA, uint64_t crcB, size_t lenB)
+{
+    // Appending B shifts A by lenB bytes, CRC without pre/post inversion is linear
+    if (!crcA)
+        return crcB;    // Zero stays zero when shifted
+    return crc_shift((uint32_t)crcA, xpow8nmodp(lenB)) ^ crcB;
 }
\ No newline at end of file
@@ -0,0 +1,298 @@
+#include "fasthash.h"
+
+#include <immintrin.h>
+
+static const uint64_t P0 = 0xa0761d6478bd642full;
+static const uint64_t P1 = 0xe7037ed1a0b428dbull;
+static const uint64_t P2 = 0x8ebc6af09c88c6e3ull;
+static const uint64_t P3 = 0x589965cc75374cc3ull;
+static const uint64_t PRIME32 = 0x9e3779b1ull;
+
+/// Key material of the striped loop: words 0..22 stripe keys, 24..31 last stripe, 32..39 scramble
+static const uint64_t FASTHASH_SECRET[40] = {
+    0x81bcba9c017e15ef, 0x2eac56ef34eae9c5, 0x3c8ad1cc6d9914b6, 0x246c851396179b58,
+    0x38d5c4d8661a4929, 0x7e654b319b8f7c60, 0x6838db557fcf1863, 0x6735bcd5923b85f8,
+    0x3890ee2a465e13f8, 0x87b308df8c3fa58d, 0xb6db7cacb7434cec, 0x9aede9f237faf4c7,
+    0xd48e46f424894dc6, 0x4bee16a7a7c766ad, 0xd13586be1df92330, 0x45bcd135ce39fd1b,
+    0xbe74c2c217ddf5f3, 0xf9f194f3c3a5c20d, 0xb0d0279d3fa4041a, 0x53bdfad14f316777,
+    0x523453a7e0a3075b, 0x5951c1749a88c90d, 0x1650009d2189e9e8, 0xf6bed246e034a245,
+    0x49633bd64189e612, 0x8b5ce71d0f6f398c, 0xc10158479010d67d, 0x031003b343d3f032,
+    0x6cef12a8584bcf59, 0x585f7f8a9f01cf16, 0xeae9ce68d5f94b1f, 0xcf22265fcfbcac2f,
+    0x6574686d5c80618e, 0x87fcbae1bee544fd, 0xecf3d1f49acadf7b, 0x8a0b4c98fc2e272d,
+    0x8792cc4e216f3101, 0x2872908832b62f6d, 0x329f747cb0a11895, 0x687644d6d623ad85};
+
+#define SECRET_WORDS    40
+#define SECRET_LAST     24
+#define SECRET_SCRAMBLE 32
+#define STRIPE_WORDS    (FASTHASH_STRIPE / 8)
+#define BLOCK_STRIPES   (FASTHASH_BLOCK / FASTHASH_STRIPE)
+
+static inline uint64_t read64(const uint8_t *p)
+{
+    uint64_t v;
+    memcpy(&v, p, sizeof(v));
+    return v;
+}
+
+static inline uint64_t read32(const uint8_t *p)
+{
+    uint32_t v;
+    memcpy(&v, p, sizeof(v));
+    return v;
+}
+
+/// Folded 64x64->128 bit product
+static inline uint64_t mum(uint64_t a, uint64_t b)
+{
+    const unsigned __int128 r = (unsigned __int128)a * b;
+    return (uint64_t)r ^ (uint64_t)(r >> 64);
+}
+
+static inline uint64_t avalanche(uint64_t h)
+{
+    h ^= h >> 37;
+    h *= 0x165667919e3779f9ull;
+    return h ^ (h >> 32);
+}
+
+/// Inputs up to 256 bytes, seed must already be mixed
+static uint64_t hashShort(const uint8_t *p, size_t len, uint64_t seed)
+{
+    uint64_t a, b;
+
+    if (len <= FASTHASH_SHORT)
+    {
+        if (len >= 4)
+        {
+            // Two overlapping reads cover 4..16 bytes
+            const size_t mid = (len >> 3) << 2;
+            a = (read32(p) << 32) | read32(p + mid);
+            b = (read32(p + len - 4) << 32) | read32(p + len - 4 - mid);
+        }
+        else if (len)
+        {
+            a = ((uint64_t)p[0] << 16) | ((uint64_t)p[len >> 1] << 8) | p[len - 1];
+            b = 0;
+        }
+        else
+            a = b = 0;
+    }
+    else
+    {
+        size_t i = len;
+        if (i > 48)
+        {
+            // Three independent multiply chains
+            uint64_t see1 = seed, see2 = seed;
+            do
+            {
+                seed = mum(read64(p) ^ P1, read64(p + 8) ^ seed);
+                see1 = mum(read64(p + 16) ^ P2, read64(p + 24) ^ see1);
+                see2 = mum(read64(p + 32) ^ P3, read64(p + 40) ^ see2);
+                p += 48;
+                i -= 48;
+            } while (i > 48);
+            seed ^= see1 ^ see2;
+        }
+        while (i > 16)
+        {
+            seed = mum(read64(p) ^ P1, read64(p + 8) ^ seed);
+            i -= 16;
+            p += 16;
+        }
+        a = read64(p + i - 16);
+        b = read64(p + i - 8);
+    }
+
+    a ^= P1;
+    b ^= seed;
+    const unsigned __int128 r = (unsigned __int128)a * b;
+    return mum((uint64_t)r ^ P0 ^ len, (uint64_t)(r >> 64) ^ P1);
+}
+
+/// acc[i ^ 1] += d[i], acc[i] += lo32(d[i] ^ key[i]) * hi32(d[i] ^ key[i])
+struct ScalarKernel
+{
+    struct Acc
+    {
+        uint64_t v[STRIPE_WORDS];
+    };
+
+    static inline Acc load(const uint64_t *acc)
+    {
+        Acc a;
+        memcpy(a.v, acc, sizeof(a.v));
+        return a;
+    }
+
+    static inline void store(uint64_t *acc, const Acc &a)
+    {
+        memcpy(acc, a.v, sizeof(a.v));
+    }
+
+    static inline void stripe(Acc &acc, const uint8_t *p, const uint64_t *key)
+    {
+        for (int i = 0; i < STRIPE_WORDS; ++i)
+        {
+            const uint64_t d  = read64(p + 8 * i);
+            const uint64_t dk = d ^ key[i];
+            acc.v[i ^ 1] += d;
+            acc.v[i] += (dk & 0xffffffff) * (dk >> 32);
+        }
+    }
+
+    static inline void scramble(Acc &acc, const uint64_t *key)
+    {
+        for (int i = 0; i < STRIPE_WORDS; ++i)
+            acc.v[i] = (acc.v[i] ^ (acc.v[i] >> 47) ^ key[i]) * PRIME32;
+    }
+};
+
+/// Same arithmetic on two 256-bit registers, the lane swap stays within 128-bit halves
+struct Avx2Kernel
+{
+    struct Acc
+    {
+        __m256i v[2];
+    };
+
+    static inline __attribute__((target("avx2"))) Acc load(const uint64_t *acc)
+    {
+        return {{_mm256_loadu_si256((const __m256i *)acc), _mm256_loadu_si256((const __m256i *)(acc + 4))}};
+    }
+
+    static inline __attribute__((target("avx2"))) void store(uint64_t *acc, const Acc &a)
+    {
+        _mm256_storeu_si256((__m256i *)acc, a.v[0]);
+        _mm256_storeu_si256((__m256i *)(acc + 4), a.v[1]);
+    }
+
+    static inline __attribute__((target("avx2"))) void stripe(Acc &acc, const uint8_t *p, const uint64_t *key)
+    {
+        for (int h = 0; h < 2; ++h)
+        {
+            const __m256i d    = _mm256_loadu_si256((const __m256i *)(p + 32 * h));
+            const __m256i dk   = _mm256_xor_si256(d, _mm256_loadu_si256((const __m256i *)(key + 4 * h)));
+            const __m256i prod = _mm256_mul_epu32(dk, _mm256_srli_epi64(dk, 32));
+            const __m256i swap = _mm256_shuffle_epi32(d, _MM_SHUFFLE(1, 0, 3, 2));
+            acc.v[h]           = _mm256_add_epi64(acc.v[h], _mm256_add_epi64(swap, prod));
+        }
+    }
+
+    static inline __attribute__((target("avx2"))) void scramble(Acc &acc, const uint64_t *key)
+    {
+        const __m256i prime = _mm256_set1_epi64x(PRIME32);
+
+        for (int h = 0; h < 2; ++h)
+        {
+            __m256i v = acc.v[h];
+            v         = _mm256_xor_si256(v, _mm256_srli_epi64(v, 47));
+            v         = _mm256_xor_si256(v, _mm256_loadu_si256((const __m256i *)(key + 4 * h)));
+
+            // 64x32 bit multiply from two 32x32->64 bit products
+            const __m256i lo = _mm256_mul_epu32(v, prime);
+            const __m256i hi = _mm256_mul_epu32(_mm256_srli_epi64(v, 32), prime);
+            acc.v[h]         = _mm256_add_epi64(lo, _mm256_slli_epi64(hi, 32));
+        }
+    }
+};
+
+/// Striped accumulation of inputs longer than FASTHASH_MEDIUM (at least one stripe)
+template <class Kernel>
+static inline void accumulate(uint64_t *accOut, const uint8_t *p, size_t len, const uint64_t *key)
+{
+    const size_t nBlocks     = (len - 1) / FASTHASH_BLOCK;
+    typename Kernel::Acc acc = Kernel::load(accOut);
+
+    for (size_t n = 0; n < nBlocks; ++n, p += FASTHASH_BLOCK)
+    {
+        for (int s = 0; s < BLOCK_STRIPES; ++s)
+            Kernel::stripe(acc, p + s * FASTHASH_STRIPE, key + s);
+        Kernel::scramble(acc, key + SECRET_SCRAMBLE);
+    }
+
+    // Partial block and the last (possibly overlapping) stripe
+    const size_t rem      = len - nBlocks * FASTHASH_BLOCK;
+    const size_t nStripes = (rem - 1) / FASTHASH_STRIPE;
+    for (size_t s = 0; s < nStripes; ++s)
+        Kernel::stripe(acc, p + s * FASTHASH_STRIPE, key + s);
+    Kernel::stripe(acc, p + rem - FASTHASH_STRIPE, key + SECRET_LAST);
+
+    Kernel::store(accOut, acc);
+}
+
+static void accumulate_scalar(uint64_t *acc, const uint8_t *p, size_t len, const uint64_t *key)
+{
+    accumulate<ScalarKernel>(acc, p, len, key);
+}
+
+__attribute__((target("avx2"), flatten)) static void accumulate_avx2(uint64_t *acc,
+                                                                     const uint8_t *p,
+                                                                     size_t len,
+                                                                     const uint64_t *key)
+{
+    accumulate<Avx2Kernel>(acc, p, len, key);
+}
+
+static void hashLong(const uint8_t *p, size_t len, uint64_t seed, uint64_t *acc, uint64_t *key)
+{
+    static const bool avx2 = __builtin_cpu_supports("avx2");
+
+    // Seeded secret, as in XXH3 the seed is added to even and subtracted from odd words
+    for (int i = 0; i < SECRET_WORDS; ++i)
+        key[i] = FASTHASH_SECRET[i] + ((i & 1) ? 0 - seed : seed);
+
+    const uint64_t init[STRIPE_WORDS] = {PRIME32, P0, P1, P2, P3, ~P0, ~P1, ~P2};
+    memcpy(acc, init, sizeof(init));
+
+    if (avx2)
+        accumulate_avx2(acc, p, len, key);
+    else
+        accumulate_scalar(acc, p, len, key);
+}
+
+static uint64_t mergeAccs(const uint64_t *acc, const uint64_t *key, uint64_t start)
+{
+    for (int i = 0; i < STRIPE_WORDS; i += 2)
+        start += mum(acc[i] ^ key[i], acc[i + 1] ^ key[i + 1]);
+    return avalanche(start);
+}
+
+uint64_t fasthash64(const void *data, size_t len, uint64_t seed)
+{
+    const uint8_t *p = (const uint8_t *)data;
+
+    if (len <= FASTHASH_MEDIUM)
+        return hashShort(p, len, seed ^ mum(seed ^ P0, P1));
+
+    uint64_t acc[STRIPE_WORDS], key[SECRET_WORDS];
+    hashLong(p, len, seed, acc, key);
+    return mergeAccs(acc, key + 11, len * P0);
+}
+
+FastHash128 fasthash128(const void *data, size_t len, uint64_t seed)
+{
+    const uint8_t *p = (const uint8_t *)data;
+
+    if (len <= FASTHASH_MEDIUM)
+    {
+        // Two independently seeded passes, short inputs are cheap
+        const uint64_t seedHi = seed ^ P3;
+        return {hashShort(p, len, seed ^ mum(seed ^ P2, P1)), hashShort(p, len, seedHi ^ mum(seedHi ^ P0, P2))};
+    }
+
+    uint64_t acc[STRIPE_WORDS], key[SECRET_WORDS];
+    hashLong(p, len, seed, acc, key);
+    return {mergeAccs(acc, key + 11, len * P0), mergeAccs(acc, key + 19, ~(len * P1))};
+}
+
+uint64_t fasthash64_u64(uint64_t key, uint64_t seed)
+{
+    // Bijective for a fixed seed, distinct integer keys never collide
+    key ^= seed * P0;
+    key ^= key >> 32;
+    key *= 0xd6e8feb86659fd93ull;
+    key ^= key >> 32;
+    key *= 0xd6e8feb86659fd93ull;
+    return key ^ (key >> 32);
+}
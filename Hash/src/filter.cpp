@@ -0,0 +1,513 @@
+#include "filter.h"
+
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include <new>
+#include <string>
+
+#include <immintrin.h>
+
+#define FILTER_KIND_BLOOM  1
+#define FILTER_KIND_CUCKOO 2
+
+/// Odd multipliers of the split block Bloom filter, one per block word
+alignas(32) static const uint32_t BLOOM_SALTS[BLOOM_BLOCK_WORDS] = {
+    0x47b6137b, 0x44974d91, 0x8824ad5b, 0xa2b7289d, 0x705495c7, 0x2df1424b, 0x9efc4947, 0x5c6bfb31};
+
+struct FilterHeader
+{
+    uint32_t magic;
+    uint32_t kind;
+    uint64_t nUnits;    // Blocks or buckets
+    uint64_t count;
+    uint32_t tagBits;
+    uint32_t hasVictim;
+    uint64_t victimIndex;
+    uint64_t victimTag;
+    uint8_t reserved[16];
+};
+static_assert(sizeof(FilterHeader) == FILTER_HEADER_SIZE, "Filter header has to fill one cache line");
+
+static void *allocTable(size_t bytes)
+{
+    bytes     = (bytes + 63) & ~(size_t)63;
+    void *ptr = aligned_alloc(64, bytes);
+    if (!ptr)
+        throw std::bad_alloc();
+    memset(ptr, 0, bytes);
+    return ptr;
+}
+
+/// Writes to a temporary file renamed over path, the old file may still back the table of a mapped filter
+static bool writeFilter(const char *path, const FilterHeader &header, const void *data, size_t bytes)
+{
+    const std::string tmpPath = std::string(path) + ".tmp";
+
+    FILE *file = fopen(tmpPath.c_str(), "wb");
+    if (!file)
+        return false;
+
+    bool ok = fwrite(&header, sizeof(header), 1, file) == 1 && fwrite(data, 1, bytes, file) == bytes;
+    if (fclose(file) || !ok || rename(tmpPath.c_str(), path))
+    {
+        remove(tmpPath.c_str());
+        return false;
+    }
+
+    return true;
+}
+
+/// Maps a saved filter copy-on-write, the table starts FILTER_HEADER_SIZE bytes after the returned address
+static void *mapFilter(const char *path, uint32_t kind, FilterHeader &header, size_t &mapSize)
+{
+    struct stat info;
+
+    int fd = open(path, O_RDONLY);
+    if (fd < 0)
+        throw std::runtime_error("Can't open filter file");
+    if (fstat(fd, &info) || !S_ISREG(info.st_mode) || (size_t)info.st_size < sizeof(header))
+    {
+        close(fd);
+        throw std::runtime_error("Invalid filter file");
+    }
+
+    mapSize   = info.st_size;
+    void *map = mmap(nullptr, mapSize, PROT_READ | PROT_WRITE, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (map == MAP_FAILED)
+        throw std::runtime_error("Can't map filter file");
+
+    memcpy(&header, map, sizeof(header));
+    if (header.magic != FILTER_MAGIC || header.kind != kind)
+    {
+        munmap(map, mapSize);
+        throw std::runtime_error("Invalid filter file");
+    }
+
+    return map;
+}
+
+/// Expected false positive rate of a split block Bloom filter with lambda keys per block on average
+static double blockFpr(double lambda)
+{
+    const int limit = (int)(lambda + 10 * sqrt(lambda) + 20);
+    double fpr = 0, p = exp(-lambda);
+
+    for (int i = 0; i < limit; ++i)
+    {
+        fpr += p * pow(1 - pow(1 - 1.0 / 32, i), BLOOM_BLOCK_WORDS);
+        p *= lambda / (i + 1);
+    }
+
+    return fpr;
+}
+
+Bloom_Filter::Bloom_Filter(size_t capacity, double fpr)
+{
+    if (!capacity || !(fpr > 0 && fpr < 1))
+        throw std::invalid_argument("Invalid Bloom filter capacity or false positive rate");
+
+    // Largest load per block which still reaches fpr
+    double lo = 1e-3, hi = 200;
+    for (int i = 0; i < 64; ++i)
+    {
+        const double mid = (lo + hi) / 2;
+        (blockFpr(mid) <= fpr ? lo : hi) = mid;
+    }
+
+    this->nBlocks = (size_t)ceil(capacity / lo);
+    if (this->nBlocks > ((size_t)1 << 32))
+        throw std::invalid_argument("Bloom filter is too large");
+    this->blocks = (uint32_t *)allocTable(this->nBlocks * BLOOM_BLOCK_WORDS * sizeof(uint32_t));
+    this->count  = 0;
+}
+
+Bloom_Filter::Bloom_Filter(const char *path)
+{
+    FilterHeader header;
+
+    this->map = mapFilter(path, FILTER_KIND_BLOOM, header, this->mapSize);
+    if (!header.nUnits || header.nUnits > ((size_t)1 << 32) ||
+        this->mapSize != FILTER_HEADER_SIZE + header.nUnits * BLOOM_BLOCK_WORDS * sizeof(uint32_t))
+    {
+        munmap(this->map, this->mapSize);
+        throw std::runtime_error("Invalid filter file");
+    }
+
+    this->nBlocks = header.nUnits;
+    this->count   = header.count;
+    this->blocks  = (uint32_t *)((uint8_t *)this->map + FILTER_HEADER_SIZE);
+}
+
+inline size_t Bloom_Filter::blockIndex(uint64_t hash) const
+{
+    return (size_t)(((hash >> 32) * this->nBlocks) >> 32);
+}
+
+void Bloom_Filter::insert(uint64_t hash)
+{
+    uint32_t *block = this->blocks + this->blockIndex(hash) * BLOOM_BLOCK_WORDS;
+    const uint32_t h = (uint32_t)hash;
+
+    for (int i = 0; i < BLOOM_BLOCK_WORDS; ++i)
+        block[i] |= 1u << ((h * BLOOM_SALTS[i]) >> 27);
+    ++this->count;
+}
+
+static inline bool testBlock(const uint32_t *block, uint32_t h)
+{
+    for (int i = 0; i < BLOOM_BLOCK_WORDS; ++i)
+    {
+        if (!(block[i] & (1u << ((h * BLOOM_SALTS[i]) >> 27))))
+            return false;
+    }
+    return true;
+}
+
+__attribute__((target("avx2"))) static inline bool testBlockAvx2(const uint32_t *block, uint32_t h)
+{
+    const __m256i salts = _mm256_load_si256((const __m256i *)BLOOM_SALTS);
+    const __m256i shift = _mm256_srli_epi32(_mm256_mullo_epi32(_mm256_set1_epi32(h), salts), 27);
+    const __m256i bits  = _mm256_sllv_epi32(_mm256_set1_epi32(1), shift);
+    return _mm256_testc_si256(_mm256_load_si256((const __m256i *)block), bits);
+}
+
+bool Bloom_Filter::contains(uint64_t hash) const
+{
+    return testBlock(this->blocks + this->blockIndex(hash) * BLOOM_BLOCK_WORDS, (uint32_t)hash);
+}
+
+void Bloom_Filter::containsBatch(const uint64_t *hashes, size_t n, bool *result) const
+{
+    static const bool avx2 = __builtin_cpu_supports("avx2");
+    const uint32_t *blocks[FILTER_BATCH];
+
+    for (size_t base = 0; base < n; base += FILTER_BATCH)
+    {
+        const size_t count = n - base < FILTER_BATCH ? n - base : FILTER_BATCH;
+
+        for (size_t k = 0; k < count; ++k)
+        {
+            blocks[k] = this->blocks + this->blockIndex(hashes[base + k]) * BLOOM_BLOCK_WORDS;
+            _mm_prefetch((const char *)blocks[k], _MM_HINT_T0);
+        }
+        if (avx2)
+        {
+            for (size_t k = 0; k < count; ++k)
+                result[base + k] = testBlockAvx2(blocks[k], (uint32_t)hashes[base + k]);
+        }
+        else
+        {
+            for (size_t k = 0; k < count; ++k)
+                result[base + k] = testBlock(blocks[k], (uint32_t)hashes[base + k]);
+        }
+    }
+}
+
+bool Bloom_Filter::save(const char *path) const
+{
+    FilterHeader header = {};
+
+    header.magic  = FILTER_MAGIC;
+    header.kind   = FILTER_KIND_BLOOM;
+    header.nUnits = this->nBlocks;
+    header.count  = this->count;
+
+    return writeFilter(path, header, this->blocks, this->getSizeBytes());
+}
+
+void Bloom_Filter::clear()
+{
+    memset(this->blocks, 0, this->getSizeBytes());
+    this->count = 0;
+}
+
+size_t Bloom_Filter::getCount() const
+{
+    return this->count;
+}
+
+size_t Bloom_Filter::getSizeBytes() const
+{
+    return this->nBlocks * BLOOM_BLOCK_WORDS * sizeof(uint32_t);
+}
+
+double Bloom_Filter::getFpr() const
+{
+    return blockFpr((double)this->count / this->nBlocks);
+}
+
+Bloom_Filter::~Bloom_Filter()
+{
+    if (this->map)
+        munmap(this->map, this->mapSize);
+    else
+        free(this->blocks);
+}
+
+Cuckoo_Filter::Cuckoo_Filter(size_t capacity, double fpr)
+{
+    if (!capacity || !(fpr > 0 && fpr < 1))
+        throw std::invalid_argument("Invalid cuckoo filter capacity or false positive rate");
+
+    // Smallest tag reaching fpr, achievable load factor drops with fewer slots per bucket
+    int tagBits = 8;
+    while (tagBits <= 32 && 2.0 * (64 / tagBits) / pow(2, tagBits) > fpr)
+        tagBits *= 2;
+    if (tagBits > 32)
+        throw std::invalid_argument("False positive rate is too low for a cuckoo filter");
+
+    const int slots   = 64 / tagBits;
+    const double load = slots == 2 ? 0.84 : slots == 4 ? 0.95 : 0.98;
+    const size_t want = (size_t)ceil(capacity / (slots * load));
+    size_t nBuckets   = 2;
+    while (nBuckets < want)
+        nBuckets *= 2;
+
+    this->init(nBuckets, tagBits);
+    this->buckets = (uint64_t *)allocTable(nBuckets * sizeof(uint64_t));
+}
+
+Cuckoo_Filter::Cuckoo_Filter(const char *path)
+{
+    FilterHeader header;
+
+    this->map = mapFilter(path, FILTER_KIND_CUCKOO, header, this->mapSize);
+
+    // Header fields index the table, a corrupt file must not lead to accesses past the mapping
+    const bool validTable = header.nUnits >= 2 && !(header.nUnits & (header.nUnits - 1)) &&
+                            header.nUnits <= this->mapSize / sizeof(uint64_t) &&
+                            (header.tagBits == 8 || header.tagBits == 16 || header.tagBits == 32) &&
+                            this->mapSize == FILTER_HEADER_SIZE + header.nUnits * sizeof(uint64_t);
+    const bool validState = validTable && header.hasVictim <= 1 &&
+                            header.count <= header.nUnits * (64 / header.tagBits) + header.hasVictim &&
+                            (!header.hasVictim || (header.victimIndex < header.nUnits && header.victimTag &&
+                                                   !(header.victimTag >> header.tagBits)));
+    if (!validState)
+    {
+        munmap(this->map, this->mapSize);
+        throw std::runtime_error("Invalid filter file");
+    }
+
+    this->init(header.nUnits, header.tagBits);
+    this->buckets     = (uint64_t *)((uint8_t *)this->map + FILTER_HEADER_SIZE);
+    this->count       = header.count;
+    this->hasVictim   = header.hasVictim;
+    this->victimIndex = header.victimIndex;
+    this->victimTag   = header.victimTag;
+}
+
+void Cuckoo_Filter::init(size_t nBuckets, int tagBits)
+{
+    this->nBuckets    = nBuckets;
+    this->tagBits     = tagBits;
+    this->slots       = 64 / tagBits;
+    this->ones        = ~0ull / ((1ull << tagBits) - 1);
+    this->highs       = this->ones << (tagBits - 1);
+    this->count       = 0;
+    this->hasVictim   = false;
+    this->victimIndex = 0;
+    this->victimTag   = 0;
+    this->rng         = 0x2545f4914f6cdd1dull;
+}
+
+/// Tag from the upper hash half, zero marks an empty slot
+inline uint64_t Cuckoo_Filter::tag(uint64_t hash) const
+{
+    const uint64_t tag = (hash >> 32) & ((1ull << this->tagBits) - 1);
+    return tag ? tag : 1;
+}
+
+/// Involution, altIndex(altIndex(i, tag), tag) == i
+inline size_t Cuckoo_Filter::altIndex(size_t index, uint64_t tag) const
+{
+    return (index ^ (tag * 0x5bd1e995)) & (this->nBuckets - 1);
+}
+
+/// Nonzero if a lane equals tag, the lowest set bit is the highest bit of the first such lane
+inline uint64_t Cuckoo_Filter::matchLanes(uint64_t bucket, uint64_t tag) const
+{
+    const uint64_t x = bucket ^ (tag * this->ones);
+    return (x - this->ones) & ~x & this->highs;
+}
+
+inline bool Cuckoo_Filter::tryInsert(size_t index, uint64_t tag)
+{
+    const uint64_t empty = this->matchLanes(this->buckets[index], 0);
+    if (!empty)
+        return false;
+
+    const int lane = __builtin_ctzll(empty) / this->tagBits;
+    this->buckets[index] |= tag << (lane * this->tagBits);
+    return true;
+}
+
+void Cuckoo_Filter::place(size_t index, uint64_t tag)
+{
+    const uint64_t laneMask = (1ull << this->tagBits) - 1;
+
+    if (this->tryInsert(index, tag) || this->tryInsert(index = this->altIndex(index, tag), tag))
+        return;
+
+    for (int kick = 0; kick < CUCKOO_MAX_KICKS; ++kick)
+    {
+        this->rng ^= this->rng << 13;
+        this->rng ^= this->rng >> 7;
+        this->rng ^= this->rng << 17;
+
+        // Swap with a random resident and move it to its other bucket
+        const int shift      = (int)(this->rng % this->slots) * this->tagBits;
+        const uint64_t other = (this->buckets[index] >> shift) & laneMask;
+        this->buckets[index] = (this->buckets[index] & ~(laneMask << shift)) | (tag << shift);
+
+        tag   = other;
+        index = this->altIndex(index, tag);
+        if (this->tryInsert(index, tag))
+            return;
+    }
+
+    this->hasVictim   = true;
+    this->victimIndex = index;
+    this->victimTag   = tag;
+}
+
+bool Cuckoo_Filter::insert(uint64_t hash)
+{
+    if (this->hasVictim)
+        return false;
+
+    this->place(hash & (this->nBuckets - 1), this->tag(hash));
+    ++this->count;
+    return true;
+}
+
+bool Cuckoo_Filter::contains(uint64_t hash) const
+{
+    const uint64_t tag = this->tag(hash);
+    const size_t i1    = hash & (this->nBuckets - 1);
+    const size_t i2    = this->altIndex(i1, tag);
+
+    if (this->matchLanes(this->buckets[i1], tag) || this->matchLanes(this->buckets[i2], tag))
+        return true;
+    return this->hasVictim && this->victimTag == tag && (this->victimIndex == i1 || this->victimIndex == i2);
+}
+
+bool Cuckoo_Filter::erase(uint64_t hash)
+{
+    const uint64_t tag = this->tag(hash);
+    const size_t i1    = hash & (this->nBuckets - 1);
+    const size_t i2    = this->altIndex(i1, tag);
+
+    if (this->hasVictim && this->victimTag == tag && (this->victimIndex == i1 || this->victimIndex == i2))
+    {
+        this->hasVictim = false;
+        --this->count;
+        return true;
+    }
+
+    for (size_t index : {i1, i2})
+    {
+        const uint64_t match = this->matchLanes(this->buckets[index], tag);
+        if (!match)
+            continue;
+
+        const int shift = __builtin_ctzll(match) / this->tagBits * this->tagBits;
+        this->buckets[index] &= ~(((1ull << this->tagBits) - 1) << shift);
+        --this->count;
+
+        // A slot is free again, the homeless tag gets another chance
+        if (this->hasVictim)
+        {
+            this->hasVictim = false;
+            this->place(this->victimIndex, this->victimTag);
+        }
+        return true;
+    }
+
+    return false;
+}
+
+void Cuckoo_Filter::containsBatch(const uint64_t *hashes, size_t n, bool *result) const
+{
+    uint64_t tags[FILTER_BATCH];
+    size_t i1[FILTER_BATCH], i2[FILTER_BATCH];
+
+    for (size_t base = 0; base < n; base += FILTER_BATCH)
+    {
+        const size_t count = n - base < FILTER_BATCH ? n - base : FILTER_BATCH;
+
+        for (size_t k = 0; k < count; ++k)
+        {
+            tags[k] = this->tag(hashes[base + k]);
+            i1[k]   = hashes[base + k] & (this->nBuckets - 1);
+            i2[k]   = this->altIndex(i1[k], tags[k]);
+            _mm_prefetch((const char *)&this->buckets[i1[k]], _MM_HINT_T0);
+            _mm_prefetch((const char *)&this->buckets[i2[k]], _MM_HINT_T0);
+        }
+        for (size_t k = 0; k < count; ++k)
+        {
+            result[base + k] = this->matchLanes(this->buckets[i1[k]], tags[k]) ||
+                               this->matchLanes(this->buckets[i2[k]], tags[k]) ||
+                               (this->hasVictim && this->victimTag == tags[k] &&
+                                (this->victimIndex == i1[k] || this->victimIndex == i2[k]));
+        }
+    }
+}
+
+bool Cuckoo_Filter::save(const char *path) const
+{
+    FilterHeader header = {};
+
+    header.magic       = FILTER_MAGIC;
+    header.kind        = FILTER_KIND_CUCKOO;
+    header.nUnits      = this->nBuckets;
+    header.count       = this->count;
+    header.tagBits     = this->tagBits;
+    header.hasVictim   = this->hasVictim;
+    header.victimIndex = this->victimIndex;
+    header.victimTag   = this->victimTag;
+
+    return writeFilter(path, header, this->buckets, this->getSizeBytes());
+}
+
+void Cuckoo_Filter::clear()
+{
+    memset(this->buckets, 0, this->getSizeBytes());
+    this->count     = 0;
+    this->hasVictim = false;
+}
+
+size_t Cuckoo_Filter::getCount() const
+{
+    return this->count;
+}
+
+size_t Cuckoo_Filter::getCapacity() const
+{
+    return this->nBuckets * this->slots;
+}
+
+int Cuckoo_Filter::getTagBits() const
+{
+    return this->tagBits;
+}
+
+size_t Cuckoo_Filter::getSizeBytes() const
+{
+    return this->nBuckets * sizeof(uint64_t);
+}
+
+Cuckoo_Filter::~Cuckoo_Filter()
+{
+    if (this->map)
+        munmap(this->map, this->mapSize);
+    else
+        free(this->buckets);
+}
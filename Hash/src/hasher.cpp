@@ -1,5 +1,21 @@
 #include "hasher.h"
 
+/// Feeds a message of any length, ippsHashUpdate would truncate a size_t length to int
+static IppStatus hashUpdate(const Ipp8u *msg, size_t lenmsg, IppsHashState *state)
+{
+    IppStatus status = ippStsNoErr;
+
+    do
+    {
+        const int len = lenmsg < HASH_UPDATE_MAX ? (int)lenmsg : HASH_UPDATE_MAX;
+        status        = ippsHashUpdate(msg, len, state);
+        msg += len;
+        lenmsg -= len;
+    } while (lenmsg && !status);
+
+    return status;
+}
+
 Hash_Coder::Hash_Coder(IppHashAlgId id)
 {
     IppStatus status;
@@ -13,11 +29,13 @@ Hash_Coder::Hash_Coder(IppHashAlgId id)
     status        = ippsHashInit(this->context, id);
     if (status != ippStsNoErr)
         throw std::runtime_error(ippGetStatusString(status));
+
+    this->id = id;
 }
 
 IppStatus Hash_Coder::update(Ipp8u *msg, size_t lenmsg)
 {
-    return ippsHashUpdate(msg, lenmsg, this->context);
+    return hashUpdate(msg, lenmsg, this->context);
 }
 
 IppStatus Hash_Coder::calcFileHash(FILE *fptr, Ipp8u *hashCode)
@@ -35,13 +53,343 @@ IppStatus Hash_Coder::calcFileHash(FILE *fptr, Ipp8u *hashCode)
     return this->getHash(hashCode);
 }
 
+IppStatus Hash_Coder::hashFile(const char *path, Ipp8u *hashCode)
+{
+    IppStatus status = ippStsNoErr;
+    struct stat info;
+
+    int fd = open(path, O_RDONLY);
+    if (fd < 0)
+        return ippStsNoOperation;
+    if (fstat(fd, &info))
+    {
+        close(fd);
+        return ippStsNoOperation;
+    }
+
+    // Regular files are mapped and fed to the hash directly from page cache
+    const size_t fileSize = info.st_size;
+    Ipp8u *map            = nullptr;
+    if (S_ISREG(info.st_mode) && fileSize > 0)
+    {
+        map = (Ipp8u *)mmap(nullptr, fileSize, PROT_READ, MAP_PRIVATE, fd, 0);
+        if (map == MAP_FAILED)
+            map = nullptr;
+    }
+
+    if (map)
+    {
+        madvise(map, fileSize, MADV_SEQUENTIAL);
+        for (size_t offset = 0; offset < fileSize && !status; offset += HASH_MMAP_CHUNK)
+        {
+            const size_t len = fileSize - offset < HASH_MMAP_CHUNK ? fileSize - offset : HASH_MMAP_CHUNK;
+
+            // Start readahead of the next window, drop the hashed one to keep resident memory low
+            const size_t left = fileSize - offset - len;
+            if (left)
+                madvise(map + offset + len, left < HASH_MMAP_CHUNK ? left : HASH_MMAP_CHUNK, MADV_WILLNEED);
+            status = ippsHashUpdate(map + offset, len, this->context);
+            madvise(map + offset, len, MADV_DONTNEED);
+        }
+        munmap(map, fileSize);
+    }
+    else
+    {
+        // Pipes, devices or failed mapping, use large aligned reads
+        Ipp8u *buf = nullptr;
+        if (posix_memalign((void **)&buf, HASH_READ_ALIGN, HASH_READ_SIZE))
+        {
+            close(fd);
+            return ippStsNoMemErr;
+        }
+        posix_fadvise(fd, 0, 0, POSIX_FADV_SEQUENTIAL);
+
+        ssize_t size = 0;
+        while (!status && ((size = read(fd, buf, HASH_READ_SIZE)) > 0 || (size < 0 && errno == EINTR)))
+        {
+            if (size > 0)
+                status = ippsHashUpdate(buf, size, this->context);
+        }
+        if (size < 0 && !status)
+            status = ippStsErr;
+        free(buf);
+    }
+    close(fd);
+
+    if (status)
+    {    // Finalize into scratch to reset the context
+        Ipp8u scratch[IPP_SHA512_DIGEST_BITSIZE / 8];
+        this->getHash(scratch);
+        return status;
+    }
+    return this->getHash(hashCode);
+}
+
 IppStatus Hash_Coder::getHash(Ipp8u *code)
 {
     return ippsHashFinal(code, this->context);
 }
 
+int Hash_Coder::getDigestSize() const
+{
+    return getDigestSize(this->id);
+}
+
+int Hash_Coder::getDigestSize(IppHashAlgId id)
+{
+    switch (id)
+    {
+        case ippHashAlg_SHA1:
+            return 20;
+        case ippHashAlg_SHA224:
+        case ippHashAlg_SHA512_224:
+            return 28;
+        case ippHashAlg_SHA256:
+        case ippHashAlg_SHA512_256:
+        case ippHashAlg_SM3:
+            return 32;
+        case ippHashAlg_SHA384:
+            return 48;
+        case ippHashAlg_SHA512:
+            return 64;
+        case ippHashAlg_MD5:
+            return 16;
+        default:
+            return 0;
+    }
+}
+
+IppStatus Hash_Coder::hashBatch(IppHashAlgId id,
+                                const Ipp8u *const *msgs,
+                                const size_t *lens,
+                                size_t n,
+                                Ipp8u *digests)
+{
+    IppStatus status = ippStsNoErr;
+
+    if (!(msgs && lens && digests))
+        return ippStsNullPtrErr;
+
+    // SHA-256 messages are interleaved over SIMD lanes if a multi-buffer kernel is usable
+    if (id == ippHashAlg_SHA256 && sha256_mb(msgs, lens, n, digests))
+        return ippStsNoErr;
+
+    // Otherwise reuse a single context, final call reinitializes it
+    Hash_Coder coder(id);
+    const int digestSize = coder.getDigestSize();
+    for (size_t i = 0; i < n && !status; ++i)
+    {
+        if (!(status = coder.update((Ipp8u *)msgs[i], lens[i])))
+            status = coder.getHash(&digests[i * digestSize]);
+    }
+
+    return status;
+}
+
 Hash_Coder::~Hash_Coder()
 {
     delete[](Ipp8u *) this->context;
     this->context = nullptr;
+}
+
+/// Volatile stores so wiping key material is not removed as a dead store
+static void wipe(void *ptr, size_t len)
+{
+    volatile Ipp8u *p = (volatile Ipp8u *)ptr;
+    while (len--)
+        *p++ = 0;
+}
+
+Hmac_Coder::Hmac_Coder(IppHashAlgId id, const Ipp8u *key, size_t keyLen)
+{
+    IppStatus status;
+
+    this->id      = id;
+    this->macSize = Hash_Coder::getDigestSize(id);
+    if (!this->macSize)
+        throw std::invalid_argument("Unsupported hash algorithm");
+
+    status = ippsHashGetSize(&this->ctxSize);
+    if (status != ippStsNoErr)
+        throw std::runtime_error(ippGetStatusString(status));
+
+    this->inner = (IppsHashState *)new Ipp8u[this->ctxSize];
+    this->outer = (IppsHashState *)new Ipp8u[this->ctxSize];
+    this->work  = (IppsHashState *)new Ipp8u[this->ctxSize];
+
+    status = this->setKey(key, keyLen);
+    if (status != ippStsNoErr)
+        throw std::runtime_error(ippGetStatusString(status));
+}
+
+IppStatus Hmac_Coder::setKey(const Ipp8u *key, size_t keyLen)
+{
+    IppStatus status            = ippStsNoErr;
+    const int blockSize         = getBlockSize(this->id);
+    Ipp8u block[HMAC_BLOCK_MAX] = {0};
+    Ipp8u pad[HMAC_BLOCK_MAX];
+
+    if (!key && keyLen)
+        return ippStsNullPtrErr;
+
+    // Keys longer than a block are replaced by their digest
+    if (keyLen > (size_t)blockSize)
+    {
+        if ((status = ippsHashInit(this->work, this->id)) ||
+            (status = hashUpdate(key, keyLen, this->work)) ||
+            (status = ippsHashFinal(block, this->work)))
+        {
+            wipe(block, sizeof(block));
+            return status;
+        }
+    }
+    else if (keyLen)
+        memcpy(block, key, keyLen);
+
+    for (int i = 0; i < blockSize; ++i)
+        pad[i] = block[i] ^ 0x36;
+    if (!(status = ippsHashInit(this->inner, this->id)))
+        status = ippsHashUpdate(pad, blockSize, this->inner);
+
+    for (int i = 0; i < blockSize && !status; ++i)
+        pad[i] = block[i] ^ 0x5c;
+    if (!status && !(status = ippsHashInit(this->outer, this->id)))
+        status = ippsHashUpdate(pad, blockSize, this->outer);
+
+    if (!status)
+        status = ippsHashDuplicate(this->inner, this->work);
+
+    wipe(block, sizeof(block));
+    wipe(pad, sizeof(pad));
+
+    return status;
+}
+
+IppStatus Hmac_Coder::update(const Ipp8u *msg, size_t lenmsg)
+{
+    return hashUpdate(msg, lenmsg, this->work);
+}
+
+IppStatus Hmac_Coder::getMac(Ipp8u *mac)
+{
+    IppStatus status = this->finish(this->work, mac);
+
+    // Next message starts from the keyed state again, also after an error
+    IppStatus reset = ippsHashDuplicate(this->inner, this->work);
+
+    return status ? status : reset;
+}
+
+IppStatus Hmac_Coder::calcMac(const Ipp8u *msg, size_t lenmsg, Ipp8u *mac)
+{
+    IppStatus status = hashUpdate(msg, lenmsg, this->work);
+    if (status)
+    {
+        ippsHashDuplicate(this->inner, this->work);
+        return status;
+    }
+
+    return this->getMac(mac);
+}
+
+IppStatus Hmac_Coder::verify(const Ipp8u *msg, size_t lenmsg, const Ipp8u *mac, size_t lenmac, bool &valid)
+{
+    Ipp8u expected[IPP_SHA512_DIGEST_BITSIZE / 8];
+    Ipp8u diff = 0;
+
+    valid = false;
+    if (!mac)
+        return ippStsNullPtrErr;
+
+    IppStatus status = this->calcMac(msg, lenmsg, expected);
+    if (status)
+        return status;
+
+    // Constant time compare, truncated MACs are accepted down to half of the digest (RFC 2104, section 5)
+    if (lenmac > (size_t)this->macSize || 2 * lenmac < (size_t)this->macSize)
+        return ippStsLengthErr;
+    for (size_t i = 0; i < lenmac; ++i)
+        diff |= expected[i] ^ mac[i];
+    valid = diff == 0;
+
+    return ippStsNoErr;
+}
+
+IppStatus Hmac_Coder::calcMacBatch(const Ipp8u *const *msgs,
+                                   const size_t *lens,
+                                   size_t n,
+                                   Ipp8u *macs,
+                                   int nThreads)
+{
+    IppStatus status = ippStsNoErr;
+
+    if (!(msgs && lens && macs))
+        return ippStsNullPtrErr;
+    if (nThreads <= 0)
+        nThreads = omp_get_max_threads();
+
+    // One working state per thread, key states are only read
+    std::vector<Ipp8u> states((size_t)nThreads * this->ctxSize);
+
+#pragma omp parallel for num_threads(nThreads) schedule(dynamic, 64)
+    for (long long i = 0; i < (long long)n; ++i)
+    {
+        IppsHashState *state = (IppsHashState *)&states[(size_t)omp_get_thread_num() * this->ctxSize];
+        IppStatus status_local;
+
+        if ((status_local = ippsHashDuplicate(this->inner, state)) ||
+            (status_local = hashUpdate(msgs[i], lens[i], state)) ||
+            (status_local = this->finish(state, &macs[i * this->macSize])))
+        {
+#pragma omp critical
+            status = status_local;
+        }
+    }
+    wipe(states.data(), states.size());
+
+    return status;
+}
+
+int Hmac_Coder::getMacSize() const
+{
+    return this->macSize;
+}
+
+int Hmac_Coder::getBlockSize(IppHashAlgId id)
+{
+    switch (id)
+    {
+        case ippHashAlg_SHA384:
+        case ippHashAlg_SHA512:
+        case ippHashAlg_SHA512_224:
+        case ippHashAlg_SHA512_256:
+            return 128;
+        default:
+            return 64;
+    }
+}
+
+/// H(outer | H(inner | msg)), state holds inner | msg
+IppStatus Hmac_Coder::finish(IppsHashState *state, Ipp8u *mac) const
+{
+    IppStatus status;
+    Ipp8u digest[IPP_SHA512_DIGEST_BITSIZE / 8];
+
+    if ((status = ippsHashFinal(digest, state)) ||
+        (status = ippsHashDuplicate(this->outer, state)) ||
+        (status = ippsHashUpdate(digest, this->macSize, state)))
+        return status;
+
+    return ippsHashFinal(mac, state);
+}
+
+Hmac_Coder::~Hmac_Coder()
+{
+    // Key states are equivalent to the key itself
+    wipe(this->inner, this->ctxSize);
+    wipe(this->outer, this->ctxSize);
+    wipe(this->work, this->ctxSize);
+    delete[](Ipp8u *) this->inner;
+    delete[](Ipp8u *) this->outer;
+    delete[](Ipp8u *) this->work;
 }
\ No newline at end of file
@@ -0,0 +1,279 @@
+#include "manifest.h"
+
+static inline Ipp64s statMtime(const struct stat &info)
+{
+    return (Ipp64s)info.st_mtim.tv_sec * 1000000000 + info.st_mtim.tv_nsec;
+}
+
+Manifest_Builder::Manifest_Builder(IppHashAlgId id, int nThreads)
+{
+    this->id         = id;
+    this->nThreads   = nThreads > 0 ? nThreads : omp_get_max_threads();
+    this->digestSize = Hash_Coder::getDigestSize(id);
+    if (!this->digestSize)
+        throw std::invalid_argument("Unsupported hash algorithm");
+
+    for (int i = 0; i < this->nThreads; ++i)
+        this->coders.emplace_back(new Hash_Coder(id));
+    this->stats = {0, 0, 0, 0, 0};
+}
+
+IppStatus Manifest_Builder::build(const char *root, const char *cachePath)
+{
+    struct timespec now;
+    struct stat info;
+
+    if (!root)
+        return ippStsNullPtrErr;
+    if (stat(root, &info) || !S_ISDIR(info.st_mode))
+        return ippStsNoOperation;
+
+    clock_gettime(CLOCK_REALTIME, &now);
+    const Ipp64s startNs = (Ipp64s)now.tv_sec * 1000000000 + now.tv_nsec;
+
+    this->root  = root;
+    this->stats = {0, 0, 0, 0, 0};
+    this->entries.clear();
+    this->walk();
+    this->digests.assign(this->entries.size() * this->digestSize, 0);
+    if (cachePath)
+        this->readCache(cachePath);
+
+    // Largest files first so a big file at the end does not leave the other threads idle
+    std::vector<size_t> todo;
+    for (size_t i = 0; i < this->entries.size(); ++i)
+    {
+        if (this->entries[i].status == ippStsNoOperation)
+            todo.push_back(i);
+    }
+    std::sort(todo.begin(), todo.end(), [this](size_t a, size_t b) {
+        return this->entries[a].size > this->entries[b].size;
+    });
+
+    size_t failed = 0;
+    Ipp64u bytes  = 0;
+#pragma omp parallel for num_threads(this->nThreads) schedule(dynamic) reduction(+ : failed, bytes)
+    for (long long k = 0; k < (long long)todo.size(); ++k)
+    {
+        Entry &entry              = this->entries[todo[k]];
+        Hash_Coder *coder         = this->coders[omp_get_thread_num()].get();
+        const std::string path    = (this->root / entry.path).string();
+        struct stat after;
+
+        entry.status = coder->hashFile(path.c_str(), &this->digests[todo[k] * this->digestSize]);
+        if (entry.status)
+        {
+            ++failed;
+            continue;
+        }
+        bytes += entry.size;
+
+        // Content read may be a mix of two versions if the file changed meanwhile
+        entry.cacheable = !lstat(path.c_str(), &after) && (Ipp64u)after.st_size == entry.size &&
+                          statMtime(after) == entry.mtimeNs && (Ipp64u)after.st_ino == entry.inode;
+    }
+
+    this->stats.hashed      = todo.size() - failed;
+    this->stats.failed     += failed;
+    this->stats.bytesHashed = bytes;
+
+    if (cachePath)
+        return this->writeCache(cachePath, startNs);
+    return ippStsNoErr;
+}
+
+IppStatus Manifest_Builder::write(FILE *out) const
+{
+    static const char HEX[] = "0123456789abcdef";
+    std::string line;
+
+    if (!out)
+        return ippStsNullPtrErr;
+
+    for (size_t i = 0; i < this->entries.size(); ++i)
+    {
+        const Entry &entry = this->entries[i];
+        if (entry.status)
+            continue;
+
+        // sha256sum convention, a leading backslash marks a name with escaped newlines or backslashes
+        const bool escape = entry.path.find_first_of("\\\n") != std::string::npos;
+        line.clear();
+        if (escape)
+            line += '\\';
+        for (int j = 0; j < this->digestSize; ++j)
+        {
+            line += HEX[this->digests[i * this->digestSize + j] >> 4];
+            line += HEX[this->digests[i * this->digestSize + j] & 15];
+        }
+        line += "  ";
+        for (char c : entry.path)
+        {
+            if (escape && c == '\\')
+                line += "\\\\";
+            else if (escape && c == '\n')
+                line += "\\n";
+            else
+                line += c;
+        }
+        line += '\n';
+
+        if (fwrite(line.data(), 1, line.size(), out) != line.size())
+            return ippStsErr;
+    }
+
+    return ippStsNoErr;
+}
+
+IppStatus Manifest_Builder::write(const char *path) const
+{
+    FILE *fptr = fopen(path, "wb");
+    if (!fptr)
+        return ippStsNoOperation;
+
+    IppStatus status = this->write(fptr);
+    if (fclose(fptr) && !status)
+        status = ippStsErr;
+
+    return status;
+}
+
+const std::vector<Manifest_Builder::Entry> &Manifest_Builder::getEntries() const
+{
+    return this->entries;
+}
+
+const Ipp8u *Manifest_Builder::getDigest(size_t index) const
+{
+    return &this->digests[index * this->digestSize];
+}
+
+Manifest_Builder::Stats Manifest_Builder::getStats() const
+{
+    return this->stats;
+}
+
+/// Collects regular files sorted by relative path, status ippStsNoOperation marks them as not hashed yet
+void Manifest_Builder::walk()
+{
+    namespace fs = std::filesystem;
+    std::vector<fs::path> dirs(1, this->root);
+    struct stat info;
+
+    // Explicit stack instead of a recursive iterator, a directory that fails (removed meanwhile, I/O error) is
+    // counted and skipped while the rest of the tree is still walked
+    while (!dirs.empty())
+    {
+        const fs::path dir = std::move(dirs.back());
+        std::error_code ec;
+        dirs.pop_back();
+
+        fs::directory_iterator it(dir, fs::directory_options::skip_permission_denied, ec), end;
+        for (; !ec && it != end; it.increment(ec))
+        {
+            if (lstat(it->path().c_str(), &info))
+                continue;
+            if (S_ISDIR(info.st_mode))
+                dirs.push_back(it->path());    // Symbolic links are not followed
+            if (!S_ISREG(info.st_mode))
+                continue;
+
+            Entry entry;
+            entry.path      = it->path().lexically_relative(this->root).generic_string();
+            entry.size      = info.st_size;
+            entry.mtimeNs   = statMtime(info);
+            entry.dev       = info.st_dev;
+            entry.inode     = info.st_ino;
+            entry.status    = ippStsNoOperation;
+            entry.cacheable = false;
+            this->entries.push_back(std::move(entry));
+        }
+        if (ec)
+            ++this->stats.failed;
+    }
+
+    std::sort(this->entries.begin(), this->entries.end(), [](const Entry &a, const Entry &b) {
+        return a.path < b.path;
+    });
+    this->stats.files = this->entries.size();
+}
+
+void Manifest_Builder::readCache(const char *cachePath)
+{
+    CacheHeader header;
+
+    FILE *fptr = fopen(cachePath, "rb");
+    if (!fptr)
+        return;    // First run
+
+    // A cache of another algorithm is ignored, everything is rehashed and the cache replaced
+    if (fread(&header, sizeof(header), 1, fptr) != 1 || header.magic != MANIFEST_CACHE_MAGIC ||
+        header.id != (Ipp32u)this->id || header.digestSize != (Ipp32u)this->digestSize)
+    {
+        fclose(fptr);
+        return;
+    }
+
+    Flat_HashMap<CacheKey, size_t, CacheKeyHash> index(this->entries.size());
+    for (size_t i = 0; i < this->entries.size(); ++i)
+        index.insert(cacheKey(this->entries[i]), i);
+
+    const size_t recordSize = sizeof(CacheKey) + this->digestSize;
+    std::vector<Ipp8u> record(recordSize);
+    for (Ipp64u r = 0; r < header.count && fread(record.data(), 1, recordSize, fptr) == recordSize; ++r)
+    {
+        CacheKey key;
+        memcpy(&key, record.data(), sizeof(key));
+
+        const size_t *i = index.find(key);
+        if (!i)
+            continue;
+        memcpy(&this->digests[*i * this->digestSize], record.data() + sizeof(key), this->digestSize);
+        this->entries[*i].status    = ippStsNoErr;
+        this->entries[*i].cacheable = true;
+        ++this->stats.cached;
+    }
+    fclose(fptr);
+}
+
+/// Replaces the cache with the current files, written to a temporary file first so a crash keeps the old cache
+IppStatus Manifest_Builder::writeCache(const char *cachePath, Ipp64s startNs) const
+{
+    const std::string tmpPath = std::string(cachePath) + ".tmp";
+    const size_t recordSize   = sizeof(CacheKey) + this->digestSize;
+    std::vector<Ipp8u> buffer;
+    CacheHeader header = {MANIFEST_CACHE_MAGIC, (Ipp32u)this->id, (Ipp32u)this->digestSize, 0, 0};
+
+    buffer.resize(sizeof(header));
+    for (size_t i = 0; i < this->entries.size(); ++i)
+    {
+        const Entry &entry = this->entries[i];
+        if (entry.status || !entry.cacheable || entry.mtimeNs >= startNs - MANIFEST_RACY_NS)
+            continue;
+
+        const CacheKey key = cacheKey(entry);
+        const size_t pos   = buffer.size();
+        buffer.resize(pos + recordSize);
+        memcpy(&buffer[pos], &key, sizeof(key));
+        memcpy(&buffer[pos + sizeof(key)], &this->digests[i * this->digestSize], this->digestSize);
+        ++header.count;
+    }
+    memcpy(buffer.data(), &header, sizeof(header));
+
+    FILE *fptr = fopen(tmpPath.c_str(), "wb");
+    if (!fptr)
+        return ippStsNoOperation;
+    const bool ok = fwrite(buffer.data(), 1, buffer.size(), fptr) == buffer.size();
+    if (fclose(fptr) || !ok || rename(tmpPath.c_str(), cachePath))
+    {
+        remove(tmpPath.c_str());
+        return ippStsErr;
+    }
+
+    return ippStsNoErr;
+}
+
+Manifest_Builder::CacheKey Manifest_Builder::cacheKey(const Entry &entry)
+{
+    return {entry.dev, entry.inode, entry.size, entry.mtimeNs};
+}
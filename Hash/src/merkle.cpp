@@ -0,0 +1,310 @@
+#include "merkle.h"
+
+static Ipp8u *mapFile(const char *path, size_t &size)
+{
+    struct stat info;
+    Ipp8u *map = nullptr;
+
+    int fd = open(path, O_RDONLY);
+    if (fd < 0)
+        return (Ipp8u *)MAP_FAILED;
+    if (fstat(fd, &info) || !S_ISREG(info.st_mode))
+    {
+        close(fd);
+        return (Ipp8u *)MAP_FAILED;
+    }
+
+    size = info.st_size;
+    if (size)    // Empty files can not be mapped, nullptr with zero size is valid
+    {
+        map = (Ipp8u *)mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+        if (map != MAP_FAILED)
+            madvise(map, size, MADV_SEQUENTIAL);
+    }
+    close(fd);
+
+    return map;
+}
+
+Merkle_Hasher::Merkle_Hasher(IppHashAlgId id, size_t chunkSize, int nThreads)
+{
+    if (chunkSize == 0 || chunkSize > MERKLE_MAX_CHUNK)
+        throw std::invalid_argument("Invalid Merkle chunk size");
+
+    this->id         = id;
+    this->chunkSize  = chunkSize;
+    this->nThreads   = nThreads > 0 ? nThreads : omp_get_max_threads();
+    this->digestSize = Hash_Coder::getDigestSize(id);
+    if (!this->digestSize)
+        throw std::invalid_argument("Unsupported hash algorithm");
+
+    for (int i = 0; i < this->nThreads; ++i)
+        this->coders.emplace_back(new Hash_Coder(id));
+}
+
+IppStatus Merkle_Hasher::hashFile(const char *path, Ipp8u *root, const char *leafPath)
+{
+    IppStatus status = ippStsNoErr;
+    size_t fileSize  = 0;
+
+    Ipp8u *map = mapFile(path, fileSize);
+    if (map == MAP_FAILED)
+        return ippStsNoOperation;
+
+    LeafHeader header = {MERKLE_LEAF_MAGIC, (Ipp32u)this->id, this->chunkSize, fileSize, this->countLeaves(fileSize)};
+    std::vector<Ipp8u> leaves(header.nLeaves * this->digestSize);
+
+    status = this->hashChunks(map, fileSize, nullptr, header.nLeaves, leaves.data());
+    if (map)
+        munmap(map, fileSize);
+    if (status)
+        return status;
+
+    if ((status = this->calcRoot(leaves.data(), header.nLeaves, root)))
+        return status;
+    if (leafPath)
+        status = this->writeLeaves(leafPath, header, leaves.data());
+
+    return status;
+}
+
+IppStatus Merkle_Hasher::verifyChunks(const char *path,
+                                      const char *leafPath,
+                                      const std::vector<size_t> &indices,
+                                      std::vector<size_t> &changed)
+{
+    IppStatus status = ippStsNoErr;
+    size_t fileSize  = 0;
+    LeafHeader header;
+    std::vector<Ipp8u> leaves;
+
+    changed.clear();
+    if ((status = this->readLeaves(leafPath, header, leaves)))
+        return status;
+
+    Ipp8u *map = mapFile(path, fileSize);
+    if (map == MAP_FAILED)
+        return ippStsNoOperation;
+
+    // Chunks outside of the current file are changed, rest is rehashed and compared
+    const size_t nLeaves = this->countLeaves(fileSize);
+    std::vector<size_t> valid;
+    for (size_t index : indices)
+    {
+        if (index >= nLeaves || index >= header.nLeaves)
+            changed.push_back(index);
+        else
+            valid.push_back(index);
+    }
+
+    std::vector<Ipp8u> current(valid.size() * this->digestSize);
+    status = this->hashChunks(map, fileSize, valid.data(), valid.size(), current.data());
+    if (map)
+        munmap(map, fileSize);
+    if (status)
+        return status;
+
+    for (size_t k = 0; k < valid.size(); ++k)
+    {
+        if (memcmp(&current[k * this->digestSize], &leaves[valid[k] * this->digestSize], this->digestSize))
+            changed.push_back(valid[k]);
+    }
+
+    return ippStsNoErr;
+}
+
+IppStatus Merkle_Hasher::updateChunks(const char *path,
+                                      const char *leafPath,
+                                      const std::vector<size_t> &indices,
+                                      Ipp8u *root)
+{
+    IppStatus status = ippStsNoErr;
+    size_t fileSize  = 0;
+    LeafHeader header;
+    std::vector<Ipp8u> leaves;
+
+    if ((status = this->readLeaves(leafPath, header, leaves)))
+        return status;
+
+    Ipp8u *map = mapFile(path, fileSize);
+    if (map == MAP_FAILED)
+        return ippStsNoOperation;
+
+    // If size changed the old tail chunk and every new chunk have to be refreshed as well
+    const size_t nLeaves = this->countLeaves(fileSize);
+    std::vector<size_t> refresh;
+    for (size_t index : indices)
+    {
+        if (index < nLeaves)
+            refresh.push_back(index);
+    }
+    if (fileSize != header.fileSize)
+    {
+        for (size_t index = (header.nLeaves < nLeaves ? header.nLeaves : nLeaves) - 1; index < nLeaves; ++index)
+            refresh.push_back(index);
+    }
+
+    std::vector<Ipp8u> current(refresh.size() * this->digestSize);
+    status = this->hashChunks(map, fileSize, refresh.data(), refresh.size(), current.data());
+    if (map)
+        munmap(map, fileSize);
+    if (status)
+        return status;
+
+    leaves.resize(nLeaves * this->digestSize);
+    for (size_t k = 0; k < refresh.size(); ++k)
+        memcpy(&leaves[refresh[k] * this->digestSize], &current[k * this->digestSize], this->digestSize);
+
+    header.fileSize = fileSize;
+    header.nLeaves  = nLeaves;
+    if ((status = this->calcRoot(leaves.data(), nLeaves, root)))
+        return status;
+
+    return this->writeLeaves(leafPath, header, leaves.data());
+}
+
+IppStatus Merkle_Hasher::calcRoot(const Ipp8u *leaves, size_t nLeaves, Ipp8u *root)
+{
+    IppStatus status = ippStsNoErr;
+    const size_t ds  = this->digestSize;
+
+    if (!(leaves && root))
+        return ippStsNullPtrErr;
+    if (!nLeaves)
+        return ippStsSizeErr;
+
+    std::vector<Ipp8u> level(leaves, leaves + nLeaves * ds), next((nLeaves + 1) / 2 * ds);
+    for (size_t n = nLeaves; n > 1; n = (n + 1) / 2)
+    {
+        const long long nParent = (n + 1) / 2;
+
+#pragma omp parallel for num_threads(this->nThreads) if (nParent > 1024)
+        for (long long j = 0; j < nParent; ++j)
+        {
+            if ((size_t)(2 * j + 1) == n)
+            {    // Promote odd node
+                memcpy(&next[j * ds], &level[2 * j * ds], ds);
+                continue;
+            }
+
+            Hash_Coder *coder = this->coders[omp_get_thread_num()].get();
+            Ipp8u prefix      = MERKLE_NODE_PREFIX;
+            IppStatus status_local;
+
+            if ((status_local = coder->update(&prefix, 1)) ||
+                (status_local = coder->update(&level[2 * j * ds], 2 * ds)))
+            {    // Finalize into scratch to reset the context, the coder is reused by this thread
+                Ipp8u scratch[IPP_SHA512_DIGEST_BITSIZE / 8];
+                coder->getHash(scratch);
+            }
+            else
+                status_local = coder->getHash(&next[j * ds]);
+            if (status_local)
+            {
+#pragma omp critical
+                status = status_local;
+            }
+        }
+        if (status)
+            return status;
+
+        level.swap(next);
+    }
+    memcpy(root, level.data(), ds);
+
+    return ippStsNoErr;
+}
+
+int Merkle_Hasher::getDigestSize() const
+{
+    return this->digestSize;
+}
+
+IppStatus Merkle_Hasher::hashChunks(const Ipp8u *data,
+                                    size_t dataLen,
+                                    const size_t *indices,
+                                    size_t count,
+                                    Ipp8u *leaves)
+{
+    IppStatus status = ippStsNoErr;
+
+#pragma omp parallel for num_threads(this->nThreads) schedule(dynamic)
+    for (long long k = 0; k < (long long)count; ++k)
+    {
+        const size_t index  = indices ? indices[k] : k;
+        const size_t offset = index * this->chunkSize;
+        if (offset > dataLen || (offset == dataLen && dataLen))
+        {
+#pragma omp critical
+            status = ippStsOutOfRangeErr;
+            continue;
+        }
+
+        const size_t len  = dataLen - offset < this->chunkSize ? dataLen - offset : this->chunkSize;
+        Hash_Coder *coder = this->coders[omp_get_thread_num()].get();
+        Ipp8u prefix      = MERKLE_LEAF_PREFIX;
+        IppStatus status_local;
+
+        if ((status_local = coder->update(&prefix, 1)) || (status_local = coder->update((Ipp8u *)data + offset, len)))
+        {    // Finalize into scratch to reset the context, the coder is reused by this thread
+            Ipp8u scratch[IPP_SHA512_DIGEST_BITSIZE / 8];
+            coder->getHash(scratch);
+        }
+        else
+            status_local = coder->getHash(&leaves[k * this->digestSize]);
+        if (status_local)
+        {
+#pragma omp critical
+            status = status_local;
+        }
+    }
+
+    return status;
+}
+
+IppStatus Merkle_Hasher::readLeaves(const char *leafPath, LeafHeader &header, std::vector<Ipp8u> &leaves)
+{
+    FILE *fptr = fopen(leafPath, "rb");
+    if (!fptr)
+        return ippStsNoOperation;
+
+    if (fread(&header, sizeof(header), 1, fptr) != 1 || header.magic != MERKLE_LEAF_MAGIC ||
+        header.id != (Ipp32u)this->id || header.chunkSize != this->chunkSize ||
+        header.nLeaves != this->countLeaves(header.fileSize))
+    {
+        fclose(fptr);
+        return ippStsContextMatchErr;
+    }
+
+    leaves.resize(header.nLeaves * this->digestSize);
+    const size_t size = fread(leaves.data(), 1, leaves.size(), fptr);
+    fclose(fptr);
+
+    return size == leaves.size() ? ippStsNoErr : ippStsLengthErr;
+}
+
+IppStatus Merkle_Hasher::writeLeaves(const char *leafPath, const LeafHeader &header, const Ipp8u *leaves)
+{
+    // Written to a temporary file renamed over the old one, a crash never leaves a torn leaf file
+    const std::string tmpPath = std::string(leafPath) + ".tmp";
+
+    FILE *fptr = fopen(tmpPath.c_str(), "wb");
+    if (!fptr)
+        return ippStsNoOperation;
+
+    const size_t size = header.nLeaves * this->digestSize;
+    const bool ok     = fwrite(&header, sizeof(header), 1, fptr) == 1 && fwrite(leaves, 1, size, fptr) == size;
+    if (fclose(fptr) || !ok || rename(tmpPath.c_str(), leafPath))
+    {
+        remove(tmpPath.c_str());
+        return ippStsErr;
+    }
+
+    return ippStsNoErr;
+}
+
+inline size_t Merkle_Hasher::countLeaves(size_t fileSize) const
+{
+    // Empty file still has a single (empty) leaf
+    return fileSize ? (fileSize + this->chunkSize - 1) / this->chunkSize : 1;
+}
@@ -0,0 +1,262 @@
+#include "sha256mb.h"
+
+#include <cpuid.h>
+#include <immintrin.h>
+
+typedef uint32_t v8u __attribute__((vector_size(32)));
+typedef uint32_t v16u __attribute__((vector_size(64)));
+
+static const uint32_t SHA256_K[64] = {
+    0x428a2f98, 0x71374491, 0xb5c0fbcf, 0xe9b5dba5, 0x3956c25b, 0x59f111f1, 0x923f82a4, 0xab1c5ed5,
+    0xd807aa98, 0x12835b01, 0x243185be, 0x550c7dc3, 0x72be5d74, 0x80deb1fe, 0x9bdc06a7, 0xc19bf174,
+    0xe49b69c1, 0xefbe4786, 0x0fc19dc6, 0x240ca1cc, 0x2de92c6f, 0x4a7484aa, 0x5cb0a9dc, 0x76f988da,
+    0x983e5152, 0xa831c66d, 0xb00327c8, 0xbf597fc7, 0xc6e00bf3, 0xd5a79147, 0x06ca6351, 0x14292967,
+    0x27b70a85, 0x2e1b2138, 0x4d2c6dfc, 0x53380d13, 0x650a7354, 0x766a0abb, 0x81c2c92e, 0x92722c85,
+    0xa2bfe8a1, 0xa81a664b, 0xc24b8b70, 0xc76c51a3, 0xd192e819, 0xd6990624, 0xf40e3585, 0x106aa070,
+    0x19a4c116, 0x1e376c08, 0x2748774c, 0x34b0bcb5, 0x391c0cb3, 0x4ed8aa4a, 0x5b9cca4f, 0x682e6ff3,
+    0x748f82ee, 0x78a5636f, 0x84c87814, 0x8cc70208, 0x90befffa, 0xa4506ceb, 0xbef9a3f7, 0xc67178f2};
+
+static const uint32_t SHA256_IV[8] = {
+    0x6a09e667, 0xbb67ae85, 0x3c6ef372, 0xa54ff53a, 0x510e527f, 0x9b05688c, 0x1f83d9ab, 0x5be0cd19};
+
+static const uint8_t SHA256_ZERO_BLOCK[SHA256_MB_BLOCK_SIZE] = {0};
+
+/// Scalar bookkeeping of a single lane
+struct MbLane
+{
+    const uint8_t *ptr;    // Next full block of the message
+    size_t blocks;         // Full blocks left
+    int padBlocks;         // Padding blocks (1 or 2)
+    int padIdx;            // Padding blocks consumed
+    size_t msg;            // Index of the message in this lane
+    bool active;
+    uint8_t pad[2 * SHA256_MB_BLOCK_SIZE];
+};
+
+static inline void store32be(uint8_t *ptr, uint32_t value)
+{
+    value = __builtin_bswap32(value);
+    memcpy(ptr, &value, sizeof(value));
+}
+
+static void laneLoad(MbLane &lane, size_t msg, const uint8_t *data, size_t len)
+{
+    const size_t rem = len % SHA256_MB_BLOCK_SIZE;
+    const uint64_t bits = (uint64_t)len * 8;
+
+    lane.ptr       = data;
+    lane.blocks    = len / SHA256_MB_BLOCK_SIZE;
+    lane.padBlocks = rem < 56 ? 1 : 2;
+    lane.padIdx    = 0;
+    lane.msg       = msg;
+    lane.active    = true;
+
+    // Tail, 0x80 terminator and big endian bit length
+    memset(lane.pad, 0, sizeof(lane.pad));
+    if (rem)
+        memcpy(lane.pad, data + len - rem, rem);
+    lane.pad[rem] = 0x80;
+    for (int n = 0; n < 8; ++n)
+        lane.pad[lane.padBlocks * SHA256_MB_BLOCK_SIZE - 1 - n] = (uint8_t)(bits >> (8 * n));
+}
+
+static inline const uint8_t *laneBlock(const MbLane &lane)
+{
+    if (!lane.active)
+        return SHA256_ZERO_BLOCK;
+    if (lane.blocks)
+        return lane.ptr;
+    return &lane.pad[lane.padIdx * SHA256_MB_BLOCK_SIZE];
+}
+
+/// Advances lane by one block, returns true if the message is complete
+static inline bool laneAdvance(MbLane &lane)
+{
+    if (!lane.active)
+        return false;
+    if (lane.blocks)
+    {
+        lane.ptr += SHA256_MB_BLOCK_SIZE;
+        --lane.blocks;
+        return false;
+    }
+    return ++lane.padIdx == lane.padBlocks;
+}
+
+#define ROTR(x, n) (((x) >> (n)) | ((x) << (32 - (n))))
+
+/// Loads big endian word t of every lane block with 64-bit gathers (block pointers are used as gather indices)
+static inline __attribute__((target("avx2"))) void loadWords(v8u &w, const __m256i *addr, int t)
+{
+    const __m256i bswap = _mm256_set_epi8(12, 13, 14, 15, 8, 9, 10, 11, 4, 5, 6, 7, 0, 1, 2, 3,
+                                          12, 13, 14, 15, 8, 9, 10, 11, 4, 5, 6, 7, 0, 1, 2, 3);
+    const __m128i lo = _mm256_i64gather_epi32((const int *)(intptr_t)(4 * t), addr[0], 1);
+    const __m128i hi = _mm256_i64gather_epi32((const int *)(intptr_t)(4 * t), addr[1], 1);
+    w = (v8u)_mm256_shuffle_epi8(_mm256_set_m128i(hi, lo), bswap);
+}
+
+static inline __attribute__((target("avx512f"))) void loadWords(v16u &w, const __m512i *addr, int t)
+{
+    const __m256i bswap = _mm256_set_epi8(12, 13, 14, 15, 8, 9, 10, 11, 4, 5, 6, 7, 0, 1, 2, 3,
+                                          12, 13, 14, 15, 8, 9, 10, 11, 4, 5, 6, 7, 0, 1, 2, 3);
+    const __m256i zero  = _mm256_setzero_si256();
+    const __m256i lo    = _mm512_mask_i64gather_epi32(zero, 0xff, addr[0], (const void *)(intptr_t)(4 * t), 1);
+    const __m256i hi    = _mm512_mask_i64gather_epi32(zero, 0xff, addr[1], (const void *)(intptr_t)(4 * t), 1);
+    w = __builtin_shufflevector((v8u)_mm256_shuffle_epi8(lo, bswap),
+                                (v8u)_mm256_shuffle_epi8(hi, bswap),
+                                0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14, 15);
+}
+
+/// One compression of a block per lane, state is in SoA layout (state[i][lane])
+template <typename V, typename A>
+static inline void compress(V *state, const A *addr)
+{
+    V w[16];
+    V a = state[0], b = state[1], c = state[2], d = state[3];
+    V e = state[4], f = state[5], g = state[6], h = state[7];
+
+    for (int t = 0; t < 16; ++t)
+        loadWords(w[t], addr, t);
+
+    for (int t = 0; t < 64; ++t)
+    {
+        if (t >= 16)
+        {
+            const V w15 = w[(t - 15) & 15], w2 = w[(t - 2) & 15];
+            const V s0  = ROTR(w15, 7) ^ ROTR(w15, 18) ^ (w15 >> 3);
+            const V s1  = ROTR(w2, 17) ^ ROTR(w2, 19) ^ (w2 >> 10);
+            w[t & 15] += s0 + s1 + w[(t - 7) & 15];
+        }
+
+        const V S1  = ROTR(e, 6) ^ ROTR(e, 11) ^ ROTR(e, 25);
+        const V ch  = (e & f) ^ (~e & g);
+        const V t1  = h + S1 + ch + SHA256_K[t] + w[t & 15];
+        const V S0  = ROTR(a, 2) ^ ROTR(a, 13) ^ ROTR(a, 22);
+        const V maj = (a & b) ^ (a & c) ^ (b & c);
+
+        h = g;
+        g = f;
+        f = e;
+        e = d + t1;
+        d = c;
+        c = b;
+        b = a;
+        a = t1 + S0 + maj;
+    }
+
+    state[0] += a;
+    state[1] += b;
+    state[2] += c;
+    state[3] += d;
+    state[4] += e;
+    state[5] += f;
+    state[6] += g;
+    state[7] += h;
+}
+
+template <typename V, typename A, int LANES>
+static inline void run(const uint8_t *const *msgs, const size_t *lens, size_t n, uint8_t *digests)
+{
+    MbLane lanes[LANES];
+    A addr[LANES * sizeof(void *) / sizeof(A)];    // Block pointers of the lanes, used as gather indices
+    V state[8];
+    size_t next = 0;
+    int nActive = 0;
+
+    for (int l = 0; l < LANES; ++l)
+    {
+        lanes[l].active = false;
+        if (next < n)
+        {
+            laneLoad(lanes[l], next, msgs[next], lens[next]);
+            ++next;
+            ++nActive;
+        }
+        for (int i = 0; i < 8; ++i)
+            state[i][l] = SHA256_IV[i];
+    }
+
+    while (nActive)
+    {
+        for (int l = 0; l < LANES; ++l)
+            ((const uint8_t **)addr)[l] = laneBlock(lanes[l]);
+
+        compress(state, addr);
+
+        for (int l = 0; l < LANES; ++l)
+        {
+            if (!laneAdvance(lanes[l]))
+                continue;
+
+            // Message complete, emit digest and refill lane
+            uint8_t *out = &digests[lanes[l].msg * SHA256_MB_DIGEST_SIZE];
+            for (int i = 0; i < 8; ++i)
+            {
+                store32be(&out[4 * i], state[i][l]);
+                state[i][l] = SHA256_IV[i];
+            }
+
+            lanes[l].active = false;
+            --nActive;
+            if (next < n)
+            {
+                laneLoad(lanes[l], next, msgs[next], lens[next]);
+                ++next;
+                ++nActive;
+            }
+        }
+    }
+}
+
+// Kernels are flattened so the generic templates are compiled for the target of the entry point
+__attribute__((target("avx2"), flatten)) static void sha256_mb_avx2(const uint8_t *const *msgs,
+                                                                    const size_t *lens,
+                                                                    size_t n,
+                                                                    uint8_t *digests)
+{
+    run<v8u, __m256i, 8>(msgs, lens, n, digests);
+}
+
+__attribute__((target("avx512f"), flatten)) static void sha256_mb_avx512(const uint8_t *const *msgs,
+                                                                                   const size_t *lens,
+                                                                                   size_t n,
+                                                                                   uint8_t *digests)
+{
+    run<v16u, __m512i, 16>(msgs, lens, n, digests);
+}
+
+static int detectLanes()
+{
+    unsigned int eax, ebx = 0, ecx, edx;
+    const bool shaNI = __get_cpuid_count(7, 0, &eax, &ebx, &ecx, &edx) && (ebx & (1 << 29));
+
+    // With SHA extensions a single stream is already faster than the SIMD lanes
+    if (shaNI)
+        return 0;
+    if (__builtin_cpu_supports("avx512f"))
+        return 16;
+    if (__builtin_cpu_supports("avx2"))
+        return 8;
+    return 0;
+}
+
+int sha256_mb_lanes()
+{
+    static const int lanes = detectLanes();    // Initialized once, also with concurrent first calls
+    return lanes;
+}
+
+int sha256_mb(const uint8_t *const *msgs, const size_t *lens, size_t n, uint8_t *digests)
+{
+    switch (sha256_mb_lanes())
+    {
+        case 16:
+            sha256_mb_avx512(msgs, lens, n, digests);
+            return 16;
+        case 8:
+            sha256_mb_avx2(msgs, lens, n, digests);
+            return 8;
+        default:
+            return 0;
+    }
+}
@@ -0,0 +1,93 @@
+#pragma once
+
+#include <string.h>
+#include <math.h>
+
+#include <stdexcept>
+#include <vector>
+
+#include <omp.h>
+
+#include <mkl.h>
+
+#include "transform.h"
+
+#define MFCC_LOG_FLOOR 1e-10    // Added to mel energies before the logarithm
+
+/**
+ * Log-mel spectra and MFCCs of a signal, computed frame by frame in one parallel loop.
+ *
+ * Each thread transforms a frame with the committed plan of its Spectrogram slot, squares the spectrum into its own
+ * scratch buffer and projects it on the mel filterbank, so the power spectrogram of the whole signal never exists in
+ * memory. The triangular filters (HTK mel scale, peak 1) are stored as one contiguous run of non-zero weights per
+ * filter, the projection touches each bin at most twice instead of nMels times. Powers are those of the unscaled DFT.
+ *
+ * Log-mel values are natural logarithms of the mel energies plus MFCC_LOG_FLOOR, MFCCs their orthonormal DCT-II.
+ */
+class MFCC_Extractor
+{
+  public:
+    MFCC_Extractor(const double *window,
+                   int wlen,
+                   int overlap,
+                   double sampleRate,
+                   int nMels,
+                   int nCoeffs,
+                   double fMin  = 0,
+                   double fMax  = 0,    // 0 for sampleRate / 2
+                   int nThreads = 0);
+    MFCC_Extractor(const MFCC_Extractor &)            = delete;
+    MFCC_Extractor &operator=(const MFCC_Extractor &) = delete;
+
+    /**
+     * @brief               Computes log-mel spectra
+     *
+     * @param data          Signal
+     * @param dataLen       Number of samples
+     * @param output        getFrames(dataLen) * getMels() values, one row per frame
+     * @return long         DFTI or VML error status
+     */
+    long computeLogMel(const double *data, size_t dataLen, double *output);
+
+    /**
+     * @brief               Computes MFCCs
+     *
+     * @param data          Signal
+     * @param dataLen       Number of samples
+     * @param output        getFrames(dataLen) * getCoeffs() values, one row per frame
+     * @return long         DFTI or VML error status
+     */
+    long computeMfcc(const double *data, size_t dataLen, double *output);
+
+    /**
+     * @brief               Regression deltas over +-width frames, edge frames repeated
+     *
+     * @param features      nFrames * nFeatures values, one row per frame
+     * @param nFrames       Number of frames
+     * @param nFeatures     Values per frame
+     * @param width         Frames on each side, 2 is the common choice
+     * @param output        nFrames * nFeatures values, apply again to features deltas for accelerations
+     */
+    static void computeDeltas(const double *features, size_t nFrames, int nFeatures, int width, double *output);
+
+    size_t getFrames(size_t dataLen) const;
+    int getMels() const;
+    int getCoeffs() const;
+    ~MFCC_Extractor();
+
+  private:
+    Spectrogram spec;
+    int nThreads;
+    int bins;
+    int nMels;
+    int nCoeffs;
+    std::vector<int> filterFirst;         // First non-zero bin of each filter
+    std::vector<int> filterOffset;        // nMels + 1 offsets of the filters in filterWeights
+    std::vector<double> filterWeights;    // Non-zero weights, scaled by wlen^2 for the 1/wlen forward scale
+    std::vector<double> dct;              // nCoeffs * nMels, orthonormal DCT-II
+    size_t scratchStride;                 // Doubles per thread in scratch, multiple of 64 bytes
+    double *scratch = nullptr;            // Spectrum, power and mel energies of each thread
+
+    long computeFrames(const double *data, size_t dataLen, double *output, bool mfcc);
+    long frameFeatures(int thread, const double *data, double *output, bool mfcc);
+};
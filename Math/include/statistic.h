@@ -1,25 +1,260 @@
 #pragma once
 
+#include <stdint.h>
+#include <stddef.h>
+#include <math.h>
+
+#include <vector>
+
+#include <omp.h>
 #include <xmmintrin.h>
 
+#define STATS_BLOCK_ELEMENTS 16384    // Elements per two-pass block, 128 KB of doubles stays in L2
+#define STATS_MAX_LANES      8        // Widest kernel, doubles per AVX-512 register
+#define STATS_TDIGEST_DELTA  200      // Default compression, about 2 * delta centroids at most
+#define STATS_TDIGEST_BUFFER 8        // Samples buffered per unit of compression between merge passes
+#define STATS_HIST_COPIES    4        // Interleaved sub-histograms, consecutive samples never wait on the same counter
+
 /// Compare and set maximum values
-inline void maxSet(const __m128 &data, __m128 &max);
+inline void maxSet(const __m128 &data, __m128 &max)
+{
+    __m128 mask = _mm_cmpgt_ps(data, max);
+    __m128 buff1 = _mm_and_ps(data, mask);
+    __m128 buff2 = _mm_andnot_ps(mask, max);
+    max = _mm_add_ps(buff1, buff2);
+    return;
+}
 
 /// Compare and set minimum values
-inline void minSet(const __m128 &data, __m128 &min);
+inline void minSet(const __m128 &data, __m128 &min)
+{
+    __m128 mask = _mm_cmplt_ps(data, min);
+    __m128 buff1 = _mm_and_ps(data, mask);
+    __m128 buff2 = _mm_andnot_ps(mask, min);
+    min = _mm_add_ps(buff1, buff2);
+    return;
+}
 
 /// Update provided mean values
 inline void meanWalk(const __m128 &data,
                      const __m128 &oldmean,
                      const uint32_t n,
-                     __m128 &mean);
+                     __m128 &mean)
+{
+    mean = _mm_sub_ps(data, oldmean);
+    mean = _mm_div_ps(mean, _mm_set1_ps(n));
+    mean = _mm_add_ps(mean, oldmean);
+    return;
+}
 
 /// Update provided std values
 inline void stdWalk(const __m128 &data,
                     const __m128 &oldmean,
                     const __m128 &mean,
                     const __m128 &oldStd,
-                    __m128 &Std);
+                    __m128 &Std)
+{
+    __m128 buff1 = _mm_sub_ps(data, oldmean);
+    __m128 buff2 = _mm_sub_ps(data, mean);
+    Std = _mm_mul_ps(buff1, buff2);
+    Std = _mm_add_ps(Std, oldStd);
+    return;
+}
 
 /// Calculate final std values
-inline void flushStd(const __m128 &data, const __m128 &n, float *out);
\ No newline at end of file
+inline void flushStd(const __m128 &data, const __m128 &n, float *out)
+{
+    __m128 buff = _mm_div_ps(data, _mm_sub_ps(n, _mm_set1_ps(1)));
+    buff = _mm_sqrt_ps(buff);
+    _mm_store_ps(out, buff);
+    return;
+}
+
+/**
+ * Moments of a single column, partial results of any split of the data can be merged in any order.
+ *
+ * Merging uses the pairwise update of Chan et al., the mean moves by delta * nB / n and M2 gains
+ * delta^2 * nA * nB / n, which stays accurate when the parts differ greatly in size or mean.
+ */
+struct Stats_Moments
+{
+    uint64_t count = 0;
+    double mean    = 0;
+    double m2      = 0;    // Sum of squared deviations from the mean
+    double min     = INFINITY;
+    double max     = -INFINITY;
+
+    void merge(const Stats_Moments &other);
+    double getVariance(bool sample = true) const;    // Divided by n - 1 if sample, else by n
+};
+
+/**
+ * Merging t-digest, streaming quantile sketch with bounded memory.
+ *
+ * Samples are buffered and periodically merged with the sorted centroids. A centroid may only grow while it spans
+ * less than one unit of the scale function k(q) = delta / (2 pi) * asin(2q - 1), so centroids are tiny near q = 0 and
+ * q = 1 and the relative accuracy of p99 or p99.9 is much better than that of the median. Digests merge by
+ * combining their centroids. NaN samples are ignored.
+ *
+ * update and merge leave no samples buffered, so the const queries only read and can run concurrently. Each update
+ * call costs one merge pass, samples should be passed in blocks rather than one at a time.
+ */
+class Stats_TDigest
+{
+  public:
+    Stats_TDigest(double compression = STATS_TDIGEST_DELTA);
+    void update(const double *data, size_t n);
+    void update(const float *data, size_t n);
+    void merge(const Stats_TDigest &other);
+    void reset();
+
+    uint64_t getCount() const;
+    double getCompression() const;
+    size_t getCentroids() const;
+
+    /**
+     * @brief               Estimates a quantile, linear interpolation between centroid centers, min and max
+     *
+     * @param q             Quantile in [0, 1]
+     * @return double       Estimated value, NaN if the digest is empty
+     */
+    double getQuantile(double q) const;
+    ~Stats_TDigest() = default;
+
+  private:
+    struct Centroid
+    {
+        double mean;
+        double weight;
+    };
+
+    double compression;
+    double min;
+    double max;
+    uint64_t count;
+    std::vector<Centroid> centroids;    // Sorted by mean
+    std::vector<Centroid> buffer;       // Samples of the current update, merged before it returns
+
+    template <class T>
+    void updateSamples(const T *data, size_t n);
+    void compress();
+};
+
+/**
+ * Fixed-width histogram of [low, high) with underflow and overflow counters.
+ *
+ * Bin indices of 8 (AVX-512) or 4 (AVX2) samples are computed at once, including the clamping of out of range values.
+ * Counts are spread over STATS_HIST_COPIES interleaved sub-histograms by sample position, so runs of equal values do
+ * not serialize on a single counter. NaN samples count as underflow.
+ */
+class Stats_Histogram
+{
+  public:
+    Stats_Histogram(double low, double high, size_t nBins);
+    void update(const double *data, size_t n);
+    void update(const float *data, size_t n);
+    void merge(const Stats_Histogram &other);    // Bins have to be equal
+    void reset();
+
+    size_t getBins() const;
+    double getLow() const;
+    double getHigh() const;
+    uint64_t getCount(size_t bin) const;
+    uint64_t getUnderflow() const;
+    uint64_t getOverflow() const;
+    uint64_t getTotal() const;
+    double getQuantile(double q) const;    // Interpolated within the bin, clamped to [low, high]
+    ~Stats_Histogram() = default;
+
+  private:
+    double low;
+    double high;
+    double scale;    // Bins per unit
+    size_t nBins;
+    std::vector<uint64_t> counts;    // Slot (bin + 1) * STATS_HIST_COPIES + copy, slot 0 underflow, last overflow
+
+    uint64_t slotCount(size_t slot) const;
+};
+
+/**
+ * Streaming per-column min, max, mean and variance of row-major sample arrays (rows of nColumns interleaved channels).
+ *
+ * Input is processed in blocks of about STATS_BLOCK_ELEMENTS. Each block is reduced with two vectorized passes while
+ * it is in cache: sums, minima and maxima first, then the squared deviations from the block mean (with the rounding
+ * correction of the corrected two-pass algorithm). Block results are merged into the running moments with Chan's
+ * update, so the error does not grow with the number of samples as it does with naive sums. Float input is widened
+ * and accumulated in double.
+ *
+ * Kernels are selected at runtime (AVX-512, AVX2 + FMA, scalar). Up to one register width of columns are handled as
+ * a flat array with a lane to column pattern, wider rows in column strips, so a single channel runs at full width.
+ */
+class Stats_Accumulator
+{
+  public:
+    Stats_Accumulator(size_t nColumns = 1);
+
+    /**
+     * @brief               Adds samples
+     *
+     * @param data          Row-major samples, nRows * nColumns values
+     * @param nRows         Number of rows
+     */
+    void update(const double *data, size_t nRows);
+    void update(const float *data, size_t nRows);
+
+    /**
+     * @brief               Adds samples using several threads
+     *
+     * Rows are split into one contiguous range of whole blocks per thread, the per-thread results are merged in
+     * range order, so the result does not depend on scheduling.
+     *
+     * @param data          Row-major samples, nRows * nColumns values
+     * @param nRows         Number of rows
+     * @param nThreads      Number of threads, 0 for the OpenMP default
+     */
+    void updateParallel(const double *data, size_t nRows, int nThreads = 0);
+    void updateParallel(const float *data, size_t nRows, int nThreads = 0);
+
+    /// Adds the samples seen by another accumulator with the same number of columns and sketches
+    void merge(const Stats_Accumulator &other);
+    void reset();
+
+    /// Keeps a t-digest per column from now on, quantiles cover the samples added afterwards
+    void enableQuantiles(double compression = STATS_TDIGEST_DELTA);
+    /// Keeps a histogram per column from now on
+    void enableHistogram(double low, double high, size_t nBins);
+
+    size_t getColumns() const;
+    uint64_t getCount() const;    // Rows added so far
+    double getMin(size_t column) const;
+    double getMax(size_t column) const;
+    double getMean(size_t column) const;
+    double getVariance(size_t column, bool sample = true) const;    // Divided by n - 1 if sample, else by n
+    double getStd(size_t column, bool sample = true) const;
+    Stats_Moments getMoments(size_t column) const;
+    double getQuantile(size_t column, double q) const;
+    const Stats_TDigest &getDigest(size_t column) const;
+    const Stats_Histogram &getHistogram(size_t column) const;
+    ~Stats_Accumulator() = default;
+
+  private:
+    size_t nColumns;
+    size_t blockRows;    // Multiple of the lane to column pattern period
+    uint64_t count;
+    std::vector<double> mean;
+    std::vector<double> m2;    // Sum of squared deviations from the mean
+    std::vector<double> min;
+    std::vector<double> max;
+    std::vector<double> block;     // Scratch, mean, m2, min and max of the current block
+    std::vector<double> column;    // Scratch, one column of the current block for the sketches
+    std::vector<Stats_TDigest> digests;
+    std::vector<Stats_Histogram> histograms;
+
+    Stats_Accumulator emptyCopy() const;
+    template <class T>
+    void updateSketches(const T *data, size_t nRows);
+    template <class T>
+    void updateBlocks(const T *data, size_t nRows);
+    template <class T>
+    void updateThreads(const T *data, size_t nRows, int nThreads);
+};
@@ -1,14 +1,24 @@
 #pragma once
 
 #include <stdio.h>
+#include <string.h>
 #include <math.h>
 
+#include <functional>
+#include <map>
+#include <memory>
+#include <stdexcept>
+#include <utility>
+#include <vector>
+
 #include <omp.h>
 
 #include <ipp.h>
 #include <mkl.h>
 
-#define DBLIMIT -150
+#define DBLIMIT            -150
+#define SPEC_EPS           0.0001    // Added to magnitudes before the logarithm
+#define ISTFT_ENVELOPE_MIN 1e-10     // Samples with a smaller squared window sum are left unnormalized
 
 /// Init Hilbert Transform
 inline IppStatus createhilbert(IppsHilbertSpec *&hilbert, Ipp8u *&pBuffer, const size_t wlen);
@@ -18,15 +28,341 @@ inline IppStatus calchilbert(IppsHilbertSpec *hilbert,
                               const double *data,
                               double *output,
                               const size_t wlen);
+/// Calculate Hilbert transform in single precision, no conversion passes
+IppStatus calchilbert(IppsHilbertSpec *hilbert, Ipp8u *pBuffer, const float *data, float *output, const size_t wlen);
 
 /// Init FFT (MKL)
 inline long createFFT_MKL(DFTI_DESCRIPTOR_HANDLE *fft, const int wlen);
 /// Calculate FFT (MKL)
 double *calculateFFT_MKL(double *data, double *window, int dataLen, DFTI_DESCRIPTOR_HANDLE *fft);
 
-/// Calculate spectrogram
+/// Init FFT (IPP, single precision), spec and buffer are freed with ippsFree
+IppStatus createFFT_IPP(IppsDFTSpec_R_32f *&spec, Ipp8u *&pBuffer, const int wlen);
+/// Calculate FFT (IPP, single precision), frame is wlen values of scratch, spectrum wlen / 2 + 1 bins scaled by 1/wlen
+IppStatus calculateFFT_IPP(const IppsDFTSpec_R_32f *spec,
+                           Ipp8u *pBuffer,
+                           const float *data,
+                           const float *window,
+                           float *frame,
+                           Ipp32fc *spectrum,
+                           const int wlen);
+
+/// Calculate spectrogram, rows are allocated separately and freed with MKL_free (see Spectrogram)
 long spectrogram(double* data, int dataLen, double*** output, double* window, int wlen, int overlap, int bits);
 
+/**
+ * Spectrogram in dB, 20 * log10((|X| + SPEC_EPS) / 2^bits) clamped at DBLIMIT, of frames shifted by wlen - overlap.
+ *
+ * FFT descriptors are created and committed once per thread when the object is constructed, the window and the per
+ * thread scratch buffers are allocated once and reused by every call. Frames are written to a single row-major matrix
+ * of getFrames(dataLen) x getBins() values. Magnitude, logarithm, scaling and clamping of a frame run right after its
+ * FFT while the spectrum is still in L1.
+ */
+class Spectrogram
+{
+  public:
+    Spectrogram(const double *window, int wlen, int overlap, int bits, int nThreads = 0);
+    Spectrogram(const Spectrogram &)            = delete;
+    Spectrogram &operator=(const Spectrogram &) = delete;
+
+    /**
+     * @brief               Computes the spectrogram of a signal
+     *
+     * @param data          Signal
+     * @param dataLen       Number of samples
+     * @param output        getFrames(dataLen) * getBins() values, one row per frame
+     * @return long         DFTI or VML error status
+     */
+    long compute(const double *data, size_t dataLen, double *output);
+    /// Same with the output kept in the object, valid until the next call
+    long compute(const double *data, size_t dataLen);
+
+    /**
+     * @brief               Computes the complex STFT, windowed spectra scaled by 1/wlen, input of STFT_Inverse
+     *
+     * @param data          Signal
+     * @param dataLen       Number of samples
+     * @param output        getFrames(dataLen) * getBins() values, one row per frame
+     * @return long         DFTI error status
+     */
+    long computeComplex(const double *data, size_t dataLen, MKL_Complex16 *output);
+    /// Complex spectrum of a single frame, getBins() values, same thread rules as transform
+    long spectrum(const double *data, MKL_Complex16 *output, int thread = 0);
+
+    /**
+     * @brief               Computes a single frame with the FFT plan and scratch buffers of one thread
+     *
+     * @param data          wlen samples
+     * @param output        getBins() values
+     * @param thread        Index below the number of threads, calls with the same index must not overlap
+     * @return long         DFTI error status
+     */
+    long transform(const double *data, double *output, int thread = 0);
+
+    /**
+     * @brief               Switches compute to batched execution
+     *
+     * Blocks of batchFrames frames are windowed into a strided buffer and transformed with a single
+     * DftiComputeForward call of a descriptor committed with DFTI_NUMBER_OF_TRANSFORMS, MKL spreads the transforms
+     * over its own threads. Pays off for short windows where the per-call overhead is comparable to the FFT. Frames
+     * after the last full block take the per-frame path.
+     *
+     * @param batchFrames   Frames per call, 0 for one call per frame (default)
+     * @return long         DFTI error status, batching stays off on error
+     */
+    long setBatch(int batchFrames);
+
+    size_t getFrames(size_t dataLen) const;
+    int getBins() const;    // wlen / 2 + 1
+    int getWindowLength() const;
+    int getShift() const;
+    int getBatch() const;
+    const double *getOutput() const;
+    size_t getOutputFrames() const;
+    ~Spectrogram();
+
+  private:
+    int wlen;
+    int shift;
+    int bins;
+    int nThreads;
+    int frameStride;                              // Doubles per thread in frames, multiple of 64 bytes
+    int spectrumStride;                           // Complex values per thread in spectra, multiple of 64 bytes
+    double offset;                                // -20 * bits * log10(2), the 2^-bits normalization in dB
+    std::vector<DFTI_DESCRIPTOR_HANDLE> plans;    // Committed, one per thread
+    double *window         = nullptr;
+    double *frames         = nullptr;    // Scratch, windowed frame of each thread
+    MKL_Complex16 *spectra = nullptr;    // Scratch, spectrum of each thread
+    double *output         = nullptr;
+    size_t outputFrames    = 0;
+    size_t capacity        = 0;    // Frames allocated in output
+
+    int batchFrames                  = 0;
+    DFTI_DESCRIPTOR_HANDLE batchPlan = nullptr;    // batchFrames transforms per call
+    double *batchInput               = nullptr;    // Windowed frames of a block, frameStride apart
+    MKL_Complex16 *batchSpectra      = nullptr;    // Spectra of a block, spectrumStride apart
+
+    long computeFrames(const double *data, long long first, long long last, double *output);
+    long computeBlock(const double *data, double *output);
+    void releaseBatch();
+    void release();
+};
+
+/**
+ * Single precision Spectrogram on IPP real DFTs, for 16-bit or other low resolution input.
+ *
+ * Same frames, API and dB values as Spectrogram within float accuracy. Samples, window and spectra stay in float from
+ * input to output, so twice the values fit in a register and half the bytes are moved compared to the double path.
+ */
+class Spectrogram_32f
+{
+  public:
+    Spectrogram_32f(const float *window, int wlen, int overlap, int bits, int nThreads = 0);
+    Spectrogram_32f(const Spectrogram_32f &)            = delete;
+    Spectrogram_32f &operator=(const Spectrogram_32f &) = delete;
+
+    /**
+     * @brief               Computes the spectrogram of a signal
+     *
+     * @param data          Signal
+     * @param dataLen       Number of samples
+     * @param output        getFrames(dataLen) * getBins() values, one row per frame
+     * @return IppStatus    IPP error status
+     */
+    IppStatus compute(const float *data, size_t dataLen, float *output);
+    /// Same with the output kept in the object, valid until the next call
+    IppStatus compute(const float *data, size_t dataLen);
+    /// Single frame with the plan and scratch buffers of one thread, calls with the same index must not overlap
+    IppStatus transform(const float *data, float *output, int thread = 0);
+
+    size_t getFrames(size_t dataLen) const;
+    int getBins() const;    // wlen / 2 + 1
+    int getWindowLength() const;
+    int getShift() const;
+    const float *getOutput() const;
+    size_t getOutputFrames() const;
+    ~Spectrogram_32f();
+
+  private:
+    int wlen;
+    int shift;
+    int bins;
+    int nThreads;
+    int frameStride;                           // Floats per thread in frames, multiple of 64 bytes
+    int spectrumStride;                        // Complex values per thread in spectra, multiple of 64 bytes
+    float offset;                              // -20 * bits * log10(2), the 2^-bits normalization in dB
+    std::vector<IppsDFTSpec_R_32f *> plans;    // One per thread
+    std::vector<Ipp8u *> buffers;              // DFT work buffer of each plan
+    float *window       = nullptr;
+    float *frames       = nullptr;    // Scratch, windowed frame of each thread
+    Ipp32fc *spectra    = nullptr;    // Scratch, spectrum of each thread
+    float *output       = nullptr;
+    size_t outputFrames = 0;
+    size_t capacity     = 0;    // Frames allocated in output
+
+    void release();
+};
+
+/**
+ * Incremental spectrogram of a live signal, same frames and dB values as Spectrogram.
+ *
+ * Chunks of any size are pushed as they arrive. Frames are computed as soon as their last sample is available and
+ * passed to the callback in order, frames that lie inside a chunk are read in place and only a frame spanning two
+ * chunks is assembled in a scratch buffer. Fewer than wlen samples are carried over between calls, so memory and
+ * latency are bounded by one window whatever the length of the stream.
+ */
+class STFT_Stream
+{
+  public:
+    typedef std::function<void(const double *frame, uint64_t index)> FrameCallback;    // getBins() values in dB
+
+    STFT_Stream(const double *window, int wlen, int overlap, int bits, FrameCallback callback);
+
+    /**
+     * @brief               Adds samples and emits the frames they complete
+     *
+     * @param data          Samples following the previous chunk
+     * @param n             Number of samples
+     * @return long         First DFTI error status, the samples are consumed anyway and a failed frame is skipped
+     *                      without shifting the index of the later ones
+     */
+    long push(const double *data, size_t n);
+    /// Emits the samples after the last complete frame as a zero padded frame, then starts a new stream
+    long flush();
+    void reset();
+
+    int getBins() const;
+    uint64_t getFrames() const;     // Emitted so far
+    uint64_t getSamples() const;    // Pushed so far
+    ~STFT_Stream() = default;
+
+  private:
+    Spectrogram spec;
+    FrameCallback callback;
+    size_t wlen;
+    size_t shift;
+    uint64_t samples;
+    uint64_t frames;
+    std::vector<double> tail;      // Samples from the start of the next frame on, fewer than wlen
+    std::vector<double> frame;     // Scratch, frame spanning two chunks
+    std::vector<double> output;    // Scratch, spectrum of one frame
+
+    long emit(const double *data);
+};
+
+/**
+ * Inverse STFT by weighted overlap-add, resynthesizes a signal from (modified) Spectrogram::computeComplex output.
+ *
+ * Every spectrum is transformed back, multiplied with the window again and added to the output at its frame offset.
+ * Each sample is then divided by the sum of the squared window over the frames covering it, so an unmodified STFT is
+ * reconstructed for any window and overlap, not only for COLA pairs where that sum is constant. Frames are processed
+ * in parallel with one committed plan per thread, in runs of consecutive frames of which only runs that can not
+ * overlap are in flight at the same time.
+ */
+class STFT_Inverse
+{
+  public:
+    /// Window and overlap of the forward transform
+    STFT_Inverse(const double *window, int wlen, int overlap, int nThreads = 0);
+    STFT_Inverse(const STFT_Inverse &)            = delete;
+    STFT_Inverse &operator=(const STFT_Inverse &) = delete;
+
+    /**
+     * @brief               Resynthesizes a signal
+     *
+     * @param spectra       nFrames * getBins() values, one row per frame
+     * @param nFrames       Number of frames
+     * @param output        getLength(nFrames) samples
+     * @return long         DFTI error status
+     */
+    long compute(const MKL_Complex16 *spectra, size_t nFrames, double *output);
+
+    size_t getLength(size_t nFrames) const;    // Samples covered by nFrames frames
+    int getBins() const;
+    int getWindowLength() const;
+    int getShift() const;
+    ~STFT_Inverse();
+
+  private:
+    int wlen;
+    int shift;
+    int bins;
+    int nThreads;
+    int frameStride;                              // Doubles per thread in frames, multiple of 64 bytes
+    int spectrumStride;                           // Complex values per thread in spectra, multiple of 64 bytes
+    std::vector<DFTI_DESCRIPTOR_HANDLE> plans;    // Committed, one per thread
+    double *window         = nullptr;
+    double *frames         = nullptr;    // Scratch, inverse transform of each thread
+    MKL_Complex16 *spectra = nullptr;    // Scratch, copy of the input spectrum of each thread
+
+    long inverseFrame(int thread, const MKL_Complex16 *spectrum, double *output);
+    void release();
+};
+
+/**
+ * Hilbert transform of a fixed length with initialized specs and persistent buffers, no setup or allocation per call.
+ *
+ * Holds one initialized IPP spec, work buffer and analytic signal buffer per thread. analyze computes envelope,
+ * instantaneous phase and instantaneous frequency of many signals of wlen samples in parallel, for instance the
+ * channels of a recording or overlapping windows of one channel. The frequency is the angle of z[n + 1] * conj(z[n]),
+ * which needs no phase unwrapping. Plans for repeated lengths are taken from a per thread cache with cached(wlen).
+ */
+class Hilbert_Plan
+{
+  public:
+    Hilbert_Plan(int wlen, int nThreads = 0);
+    Hilbert_Plan(const Hilbert_Plan &)            = delete;
+    Hilbert_Plan &operator=(const Hilbert_Plan &) = delete;
+
+    /// Analytic signal of wlen samples with the buffers of one thread, calls with the same index must not overlap
+    IppStatus transform(const float *data, Ipp32fc *analytic, int thread = 0);
+
+    /**
+     * @brief               Envelope, phase and frequency of several signals, outputs not needed may be nullptr
+     *
+     * @param data          nSignals signals of wlen samples
+     * @param nSignals      Number of signals
+     * @param stride        Samples between the starts of two signals, below wlen for overlapping windows
+     * @param envelope      nSignals * wlen values, magnitude of the analytic signal
+     * @param phase         nSignals * wlen values, instantaneous phase in radians
+     * @param frequency     nSignals * wlen values, instantaneous frequency, the last sample repeats the one before
+     * @param sampleRate    Frequency unit, 1 for cycles per sample
+     * @return IppStatus    IPP error status
+     */
+    IppStatus analyze(const float *data,
+                      size_t nSignals,
+                      size_t stride,
+                      float *envelope,
+                      float *phase,
+                      float *frequency,
+                      float sampleRate = 1);
+
+    /**
+     * @brief               Plan of the calling thread for a length, created on first use and kept until clearCache
+     *
+     * Called inside a parallel region the plan has a single thread, so analyze does not open a nested region and a
+     * team of n threads does not build n plans of n threads each.
+     *
+     * @param wlen          Signal length
+     * @return Hilbert_Plan& Cached plan
+     */
+    static Hilbert_Plan &cached(int wlen);
+    static void clearCache();
+
+    int getLength() const;
+    ~Hilbert_Plan();
+
+  private:
+    int wlen;
+    int nThreads;
+    std::vector<IppsHilbertSpec *> specs;    // Initialized, one per thread
+    std::vector<Ipp8u *> buffers;            // Work buffer of each spec
+    std::vector<Ipp32fc *> analytic;         // Analytic signal of each thread
+
+    static std::map<std::pair<int, int>, std::unique_ptr<Hilbert_Plan>> &cache();    // Keyed by length, threads
+    void release();
+};
+
 /// Circle intersection
 inline double **cirction(const double x0,
                          const double y0,
@@ -0,0 +1,208 @@
+#include "mfcc.h"
+
+static inline double hzToMel(double hz)
+{
+    return 2595.0 * log10(1.0 + hz / 700.0);
+}
+
+static inline double melToHz(double mel)
+{
+    return 700.0 * (pow(10.0, mel / 2595.0) - 1.0);
+}
+
+MFCC_Extractor::MFCC_Extractor(const double *window,
+                               int wlen,
+                               int overlap,
+                               double sampleRate,
+                               int nMels,
+                               int nCoeffs,
+                               double fMin,
+                               double fMax,
+                               int nThreads)
+    : spec(window, wlen, overlap, 0, nThreads > 0 ? nThreads : omp_get_max_threads())
+{
+    if (fMax == 0)
+        fMax = sampleRate / 2;
+    if (!(sampleRate > 0) || nMels < 1 || nCoeffs < 1 || nCoeffs > nMels || fMin < 0 || !(fMax > fMin) ||
+        fMax > sampleRate / 2)
+        throw std::invalid_argument("Invalid mel filterbank configuration");
+
+    this->nThreads = nThreads > 0 ? nThreads : omp_get_max_threads();
+    this->bins     = this->spec.getBins();
+    this->nMels    = nMels;
+    this->nCoeffs  = nCoeffs;
+
+    // Triangles between nMels + 2 points equally spaced on the mel scale
+    const double melLow  = hzToMel(fMin);
+    const double melHigh = hzToMel(fMax);
+    const double binHz   = sampleRate / wlen;
+    const double gain    = (double)wlen * wlen;
+    std::vector<double> edges(nMels + 2);
+    for (int m = 0; m < nMels + 2; ++m)
+        edges[m] = melToHz(melLow + (melHigh - melLow) * m / (nMels + 1));
+
+    this->filterFirst.resize(nMels);
+    this->filterOffset.assign(1, 0);
+    for (int m = 0; m < nMels; ++m)
+    {
+        const double lower  = edges[m];
+        const double center = edges[m + 1];
+        const double upper  = edges[m + 2];
+
+        this->filterFirst[m] = 0;
+        for (int k = 0; k < this->bins; ++k)
+        {
+            const double f    = k * binHz;
+            const double rise = (f - lower) / (center - lower);
+            const double fall = (upper - f) / (upper - center);
+            const double w    = rise < fall ? rise : fall;
+            if (w <= 0)
+                continue;
+
+            if (this->filterWeights.size() == (size_t)this->filterOffset.back())
+                this->filterFirst[m] = k;
+            this->filterWeights.push_back(w * gain);
+        }
+        this->filterOffset.push_back((int)this->filterWeights.size());
+    }
+
+    this->dct.resize((size_t)nCoeffs * nMels);
+    for (int i = 0; i < nCoeffs; ++i)
+    {
+        const double scale = sqrt((i ? 2.0 : 1.0) / nMels);
+        for (int m = 0; m < nMels; ++m)
+            this->dct[(size_t)i * nMels + m] = scale * cos(M_PI * i * (m + 0.5) / nMels);
+    }
+
+    this->scratchStride = ((size_t)2 * this->bins + this->bins + nMels + 7) & ~(size_t)7;
+    this->scratch       = (double *)MKL_malloc(this->nThreads * this->scratchStride * sizeof(double), 64);
+    if (!this->scratch)
+        throw std::runtime_error("Can not allocate MFCC buffers");
+}
+
+long MFCC_Extractor::computeLogMel(const double *data, size_t dataLen, double *output)
+{
+    return this->computeFrames(data, dataLen, output, false);
+}
+
+long MFCC_Extractor::computeMfcc(const double *data, size_t dataLen, double *output)
+{
+    return this->computeFrames(data, dataLen, output, true);
+}
+
+void MFCC_Extractor::computeDeltas(const double *features, size_t nFrames, int nFeatures, int width, double *output)
+{
+    double norm = 0;
+    for (int n = 1; n <= width; ++n)
+        norm += 2.0 * n * n;
+    if (!nFrames || width < 1)
+    {
+        memset(output, 0, nFrames * nFeatures * sizeof(double));
+        return;
+    }
+
+    const long long last = (long long)nFrames - 1;
+#pragma omp parallel for schedule(static)
+    for (long long t = 0; t <= last; ++t)
+    {
+        double *out = &output[t * nFeatures];
+        memset(out, 0, nFeatures * sizeof(double));
+
+        for (int n = 1; n <= width; ++n)
+        {
+            const double *next = &features[(t + n < last ? t + n : last) * nFeatures];
+            const double *prev = &features[(t - n > 0 ? t - n : 0) * nFeatures];
+            for (int j = 0; j < nFeatures; ++j)
+                out[j] += n * (next[j] - prev[j]);
+        }
+        for (int j = 0; j < nFeatures; ++j)
+            out[j] /= norm;
+    }
+}
+
+size_t MFCC_Extractor::getFrames(size_t dataLen) const
+{
+    return this->spec.getFrames(dataLen);
+}
+
+int MFCC_Extractor::getMels() const
+{
+    return this->nMels;
+}
+
+int MFCC_Extractor::getCoeffs() const
+{
+    return this->nCoeffs;
+}
+
+MFCC_Extractor::~MFCC_Extractor()
+{
+    MKL_free(this->scratch);
+}
+
+long MFCC_Extractor::computeFrames(const double *data, size_t dataLen, double *output, bool mfcc)
+{
+    const long long nFrames = (long long)this->getFrames(dataLen);
+    const int width         = mfcc ? this->nCoeffs : this->nMels;
+    const int shift         = this->spec.getShift();
+    long status             = DFTI_NO_ERROR;
+
+    if (!nFrames)
+        return DFTI_NO_ERROR;
+    if (!data || !output)
+        return DFTI_INVALID_CONFIGURATION;
+
+    const int nth = MKL_Set_Num_Threads_Local(1);    // Frames are the parallel dimension
+#pragma omp parallel for num_threads(this->nThreads) schedule(static)
+    for (long long i = 0; i < nFrames; ++i)
+    {
+        if (status)
+            continue;
+
+        const long local = this->frameFeatures(omp_get_thread_num(), &data[i * shift], &output[i * width], mfcc);
+        if (local)
+        {
+#pragma omp critical
+            status = local;
+        }
+    }
+    MKL_Set_Num_Threads_Local(nth);
+
+    return status;
+}
+
+/// Spectrum, power, sparse mel projection, log and optionally DCT of one frame in the scratch buffer of a thread
+long MFCC_Extractor::frameFeatures(int thread, const double *data, double *output, bool mfcc)
+{
+    double *base            = &this->scratch[(size_t)thread * this->scratchStride];
+    MKL_Complex16 *spectrum = (MKL_Complex16 *)base;
+    double *power           = base + 2 * this->bins;
+    double *mel             = power + this->bins;
+    double *logMel          = mfcc ? mel : output;
+
+    const long status = this->spec.spectrum(data, spectrum, thread);
+    if (status)
+        return status;
+
+    for (int k = 0; k < this->bins; ++k)
+        power[k] = spectrum[k].real * spectrum[k].real + spectrum[k].imag * spectrum[k].imag;
+
+    for (int m = 0; m < this->nMels; ++m)
+    {
+        const double *weights = &this->filterWeights[this->filterOffset[m]];
+        const double *bin     = &power[this->filterFirst[m]];
+        const int n           = this->filterOffset[m + 1] - this->filterOffset[m];
+        double energy         = MFCC_LOG_FLOOR;
+
+        for (int k = 0; k < n; ++k)
+            energy += weights[k] * bin[k];
+        logMel[m] = energy;
+    }
+    vdLn(this->nMels, logMel, logMel);
+
+    if (mfcc)
+        cblas_dgemv(CblasRowMajor, CblasNoTrans, this->nCoeffs, this->nMels, 1.0, this->dct.data(), this->nMels, mel,
+                    1, 0.0, output, 1);
+
+    return DFTI_NO_ERROR;
+}
@@ -0,0 +1,1136 @@
+#include "statistic.h"
+
+#include <string.h>
+
+#include <algorithm>
+#include <stdexcept>
+
+#include <immintrin.h>
+
+static inline size_t gcd(size_t a, size_t b)
+{
+    while (b)
+    {
+        const size_t t = a % b;
+        a              = b;
+        b              = t;
+    }
+    return a;
+}
+
+/// Chan et al. pairwise update of mean and M2 with the moments of nB further samples
+static inline void chanMerge(double nA, double &mean, double &m2, double nB, double meanB, double m2B)
+{
+    const double n     = nA + nB;
+    const double delta = meanB - mean;
+    mean += delta * nB / n;
+    m2 += m2B + delta * delta * nA * nB / n;
+}
+
+/// Block reduction without SIMD, rows outer so the inner loop runs over contiguous columns
+template <class T>
+static void blockScalar(const T *data, size_t nRows, size_t nCols, double *mean, double *m2, double *min, double *max)
+{
+    for (size_t c = 0; c < nCols; ++c)
+    {
+        mean[c] = 0;
+        min[c]  = INFINITY;
+        max[c]  = -INFINITY;
+    }
+    for (size_t r = 0; r < nRows; ++r)
+    {
+        const T *row = data + r * nCols;
+        for (size_t c = 0; c < nCols; ++c)
+        {
+            const double x = row[c];
+            mean[c] += x;
+            min[c] = x < min[c] ? x : min[c];
+            max[c] = x > max[c] ? x : max[c];
+        }
+    }
+
+    std::vector<double> dev(nCols, 0.0);
+    for (size_t c = 0; c < nCols; ++c)
+    {
+        mean[c] /= nRows;
+        m2[c] = 0;
+    }
+    for (size_t r = 0; r < nRows; ++r)
+    {
+        const T *row = data + r * nCols;
+        for (size_t c = 0; c < nCols; ++c)
+        {
+            const double d = row[c] - mean[c];
+            dev[c] += d;
+            m2[c] += d * d;
+        }
+    }
+    for (size_t c = 0; c < nCols; ++c)
+        m2[c] -= dev[c] * dev[c] / nRows;
+}
+
+/// Registers are wrapped in a struct, vector types in the generic kernels would change the ABI of non-AVX code
+struct Avx2Ops
+{
+    struct Vec
+    {
+        __m256d v;
+    };
+    static const int W = 4;
+
+    static inline __attribute__((target("avx2,fma"))) Vec zero()
+    {
+        return {_mm256_setzero_pd()};
+    }
+
+    static inline __attribute__((target("avx2,fma"))) Vec set1(double x)
+    {
+        return {_mm256_set1_pd(x)};
+    }
+
+    static inline __attribute__((target("avx2,fma"))) Vec load(const double *p)
+    {
+        return {_mm256_loadu_pd(p)};
+    }
+
+    static inline __attribute__((target("avx2,fma"))) Vec load(const float *p)
+    {
+        return {_mm256_cvtps_pd(_mm_loadu_ps(p))};
+    }
+
+    /// First n lanes, rest zero
+    static inline __attribute__((target("avx2,fma"))) Vec load(const double *p, int n)
+    {
+        const __m256i mask = _mm256_cmpgt_epi64(_mm256_set1_epi64x(n), _mm256_setr_epi64x(0, 1, 2, 3));
+        return {n == W ? _mm256_loadu_pd(p) : _mm256_maskload_pd(p, mask)};
+    }
+
+    static inline __attribute__((target("avx2,fma"))) Vec load(const float *p, int n)
+    {
+        const __m128i mask = _mm_cmpgt_epi32(_mm_set1_epi32(n), _mm_setr_epi32(0, 1, 2, 3));
+        return {_mm256_cvtps_pd(n == W ? _mm_loadu_ps(p) : _mm_maskload_ps(p, mask))};
+    }
+
+    static inline __attribute__((target("avx2,fma"))) void store(double *p, Vec a)
+    {
+        _mm256_storeu_pd(p, a.v);
+    }
+
+    static inline __attribute__((target("avx2,fma"))) Vec add(Vec a, Vec b)
+    {
+        return {_mm256_add_pd(a.v, b.v)};
+    }
+
+    static inline __attribute__((target("avx2,fma"))) Vec sub(Vec a, Vec b)
+    {
+        return {_mm256_sub_pd(a.v, b.v)};
+    }
+
+    static inline __attribute__((target("avx2,fma"))) Vec mul(Vec a, Vec b)
+    {
+        return {_mm256_mul_pd(a.v, b.v)};
+    }
+
+    static inline __attribute__((target("avx2,fma"))) Vec div(Vec a, Vec b)
+    {
+        return {_mm256_div_pd(a.v, b.v)};
+    }
+
+    /// a * b + c
+    static inline __attribute__((target("avx2,fma"))) Vec fmadd(Vec a, Vec b, Vec c)
+    {
+        return {_mm256_fmadd_pd(a.v, b.v, c.v)};
+    }
+
+    static inline __attribute__((target("avx2,fma"))) Vec min(Vec a, Vec b)
+    {
+        return {_mm256_min_pd(a.v, b.v)};
+    }
+
+    static inline __attribute__((target("avx2,fma"))) Vec max(Vec a, Vec b)
+    {
+        return {_mm256_max_pd(a.v, b.v)};
+    }
+};
+
+/// Zero-masking forms only, the unmasked min/max intrinsics trip -Wmaybe-uninitialized with GCC
+struct Avx512Ops
+{
+    struct Vec
+    {
+        __m512d v;
+    };
+    static const int W = 8;
+
+    static inline __attribute__((target("avx512f"))) Vec zero()
+    {
+        return {_mm512_setzero_pd()};
+    }
+
+    static inline __attribute__((target("avx512f"))) Vec set1(double x)
+    {
+        return {_mm512_set1_pd(x)};
+    }
+
+    static inline __attribute__((target("avx512f"))) Vec load(const double *p)
+    {
+        return {_mm512_loadu_pd(p)};
+    }
+
+    static inline __attribute__((target("avx512f"))) Vec load(const float *p)
+    {
+        return {_mm512_maskz_cvtps_pd(0xff, _mm256_loadu_ps(p))};
+    }
+
+    static inline __attribute__((target("avx512f"))) Vec load(const double *p, int n)
+    {
+        return {_mm512_maskz_loadu_pd((__mmask8)((1u << n) - 1), p)};
+    }
+
+    static inline __attribute__((target("avx512f"))) Vec load(const float *p, int n)
+    {
+        const __m256i mask = _mm256_cmpgt_epi32(_mm256_set1_epi32(n), _mm256_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7));
+        return {_mm512_maskz_cvtps_pd(0xff, _mm256_maskload_ps(p, mask))};
+    }
+
+    static inline __attribute__((target("avx512f"))) void store(double *p, Vec a)
+    {
+        _mm512_storeu_pd(p, a.v);
+    }
+
+    static inline __attribute__((target("avx512f"))) Vec add(Vec a, Vec b)
+    {
+        return {_mm512_add_pd(a.v, b.v)};
+    }
+
+    static inline __attribute__((target("avx512f"))) Vec sub(Vec a, Vec b)
+    {
+        return {_mm512_sub_pd(a.v, b.v)};
+    }
+
+    static inline __attribute__((target("avx512f"))) Vec mul(Vec a, Vec b)
+    {
+        return {_mm512_mul_pd(a.v, b.v)};
+    }
+
+    static inline __attribute__((target("avx512f"))) Vec div(Vec a, Vec b)
+    {
+        return {_mm512_div_pd(a.v, b.v)};
+    }
+
+    static inline __attribute__((target("avx512f"))) Vec fmadd(Vec a, Vec b, Vec c)
+    {
+        return {_mm512_fmadd_pd(a.v, b.v, c.v)};
+    }
+
+    static inline __attribute__((target("avx512f"))) Vec min(Vec a, Vec b)
+    {
+        return {_mm512_maskz_min_pd(0xff, a.v, b.v)};
+    }
+
+    static inline __attribute__((target("avx512f"))) Vec max(Vec a, Vec b)
+    {
+        return {_mm512_maskz_max_pd(0xff, a.v, b.v)};
+    }
+};
+
+/**
+ * Block reduction of nCols <= W columns over the flat array. Value i belongs to column i % nCols, so with
+ * V = nCols / gcd(nCols, W) registers per period every lane of register k always sees the same column. U periods are
+ * unrolled to hide the add latency.
+ */
+template <class Ops, class T, int V>
+static inline void blockFlat(const T *data,
+                             size_t nRows,
+                             size_t nCols,
+                             double *mean,
+                             double *m2,
+                             double *min,
+                             double *max)
+{
+    typedef typename Ops::Vec Vec;
+    const int W = Ops::W;
+    const int U = V == 1 ? 4 : V < 4 ? 2 : 1;
+    const int N = V * U;
+    const size_t len = nRows * nCols;
+    alignas(64) double lanes[3][V * W];
+    double dev[STATS_MAX_LANES], sq[STATS_MAX_LANES];
+    Vec s[N], lo[N], hi[N];
+    size_t i, tail;
+
+#pragma GCC unroll 8
+    for (int k = 0; k < N; ++k)
+    {
+        s[k]  = Ops::zero();
+        lo[k] = Ops::set1(INFINITY);
+        hi[k] = Ops::set1(-INFINITY);
+    }
+    for (i = 0; i + N * W <= len; i += N * W)
+    {
+#pragma GCC unroll 8
+        for (int k = 0; k < N; ++k)
+        {
+            const Vec x = Ops::load(data + i + k * W);
+            s[k]        = Ops::add(s[k], x);
+            lo[k]       = Ops::min(lo[k], x);
+            hi[k]       = Ops::max(hi[k], x);
+        }
+    }
+    for (; i + V * W <= len; i += V * W)
+    {
+#pragma GCC unroll 8
+        for (int k = 0; k < V; ++k)
+        {
+            const Vec x = Ops::load(data + i + k * W);
+            s[k]        = Ops::add(s[k], x);
+            lo[k]       = Ops::min(lo[k], x);
+            hi[k]       = Ops::max(hi[k], x);
+        }
+    }
+    tail = i;
+#pragma GCC unroll 8
+    for (int k = V; k < N; ++k)
+    {
+        s[k % V]  = Ops::add(s[k % V], s[k]);
+        lo[k % V] = Ops::min(lo[k % V], lo[k]);
+        hi[k % V] = Ops::max(hi[k % V], hi[k]);
+    }
+#pragma GCC unroll 8
+    for (int k = 0; k < V; ++k)
+    {
+        Ops::store(lanes[0] + k * W, s[k]);
+        Ops::store(lanes[1] + k * W, lo[k]);
+        Ops::store(lanes[2] + k * W, hi[k]);
+    }
+
+    for (size_t c = 0; c < nCols; ++c)
+    {
+        mean[c] = 0;
+        min[c]  = INFINITY;
+        max[c]  = -INFINITY;
+    }
+    for (int e = 0; e < V * W; ++e)
+    {
+        const size_t c = e % nCols;
+        mean[c] += lanes[0][e];
+        min[c] = lanes[1][e] < min[c] ? lanes[1][e] : min[c];
+        max[c] = lanes[2][e] > max[c] ? lanes[2][e] : max[c];
+    }
+    for (size_t j = tail; j < len; ++j)    // Tail starts at a row boundary
+    {
+        const size_t c = (j - tail) % nCols;
+        const double x = data[j];
+        mean[c] += x;
+        min[c] = x < min[c] ? x : min[c];
+        max[c] = x > max[c] ? x : max[c];
+    }
+    for (size_t c = 0; c < nCols; ++c)
+        mean[c] /= nRows;
+
+    // Second pass, deviations from the block mean
+    Vec mv[V], d[N], q[N];
+    for (int e = 0; e < V * W; ++e)
+        lanes[0][e] = mean[e % nCols];
+#pragma GCC unroll 8
+    for (int k = 0; k < V; ++k)
+        mv[k] = Ops::load(lanes[0] + k * W);
+#pragma GCC unroll 8
+    for (int k = 0; k < N; ++k)
+        d[k] = q[k] = Ops::zero();
+
+    for (i = 0; i + N * W <= len; i += N * W)
+    {
+#pragma GCC unroll 8
+        for (int k = 0; k < N; ++k)
+        {
+            const Vec x = Ops::sub(Ops::load(data + i + k * W), mv[k % V]);
+            d[k]        = Ops::add(d[k], x);
+            q[k]        = Ops::fmadd(x, x, q[k]);
+        }
+    }
+    for (; i + V * W <= len; i += V * W)
+    {
+#pragma GCC unroll 8
+        for (int k = 0; k < V; ++k)
+        {
+            const Vec x = Ops::sub(Ops::load(data + i + k * W), mv[k]);
+            d[k]        = Ops::add(d[k], x);
+            q[k]        = Ops::fmadd(x, x, q[k]);
+        }
+    }
+#pragma GCC unroll 8
+    for (int k = V; k < N; ++k)
+    {
+        d[k % V] = Ops::add(d[k % V], d[k]);
+        q[k % V] = Ops::add(q[k % V], q[k]);
+    }
+#pragma GCC unroll 8
+    for (int k = 0; k < V; ++k)
+    {
+        Ops::store(lanes[1] + k * W, d[k]);
+        Ops::store(lanes[2] + k * W, q[k]);
+    }
+
+    for (size_t c = 0; c < nCols; ++c)
+        dev[c] = sq[c] = 0;
+    for (int e = 0; e < V * W; ++e)
+    {
+        dev[e % nCols] += lanes[1][e];
+        sq[e % nCols] += lanes[2][e];
+    }
+    for (size_t j = tail; j < len; ++j)
+    {
+        const size_t c = (j - tail) % nCols;
+        const double x = data[j] - mean[c];
+        dev[c] += x;
+        sq[c] += x * x;
+    }
+    for (size_t c = 0; c < nCols; ++c)
+        m2[c] = sq[c] - dev[c] * dev[c] / nRows;
+}
+
+/// Block reduction of nCols > W columns, W wide column strips with four rows in flight
+template <class Ops, class T>
+static inline void blockStrip(const T *data,
+                              size_t nRows,
+                              size_t nCols,
+                              double *mean,
+                              double *m2,
+                              double *min,
+                              double *max)
+{
+    typedef typename Ops::Vec Vec;
+    const int W = Ops::W;
+    const Vec rows = Ops::set1((double)nRows);
+    alignas(64) double lanes[4][W];
+
+    for (size_t j = 0; j < nCols; j += W)
+    {
+        const int n = nCols - j < (size_t)W ? (int)(nCols - j) : W;
+        Vec s[4], lo[4], hi[4];
+        size_t r;
+
+#pragma GCC unroll 8
+        for (int u = 0; u < 4; ++u)
+        {
+            s[u]  = Ops::zero();
+            lo[u] = Ops::set1(INFINITY);
+            hi[u] = Ops::set1(-INFINITY);
+        }
+        for (r = 0; r + 4 <= nRows; r += 4)
+        {
+#pragma GCC unroll 8
+            for (int u = 0; u < 4; ++u)
+            {
+                const Vec x = Ops::load(data + (r + u) * nCols + j, n);
+                s[u]        = Ops::add(s[u], x);
+                lo[u]       = Ops::min(lo[u], x);
+                hi[u]       = Ops::max(hi[u], x);
+            }
+        }
+        for (; r < nRows; ++r)
+        {
+            const Vec x = Ops::load(data + r * nCols + j, n);
+            s[0]        = Ops::add(s[0], x);
+            lo[0]       = Ops::min(lo[0], x);
+            hi[0]       = Ops::max(hi[0], x);
+        }
+        const Vec mv = Ops::div(Ops::add(Ops::add(s[0], s[1]), Ops::add(s[2], s[3])), rows);
+        Ops::store(lanes[0], mv);
+        Ops::store(lanes[1], Ops::min(Ops::min(lo[0], lo[1]), Ops::min(lo[2], lo[3])));
+        Ops::store(lanes[2], Ops::max(Ops::max(hi[0], hi[1]), Ops::max(hi[2], hi[3])));
+
+        // Second pass over the same strip, still in cache
+        Vec d[4], q[4];
+#pragma GCC unroll 8
+        for (int u = 0; u < 4; ++u)
+            d[u] = q[u] = Ops::zero();
+        for (r = 0; r + 4 <= nRows; r += 4)
+        {
+#pragma GCC unroll 8
+            for (int u = 0; u < 4; ++u)
+            {
+                const Vec x = Ops::sub(Ops::load(data + (r + u) * nCols + j, n), mv);
+                d[u]        = Ops::add(d[u], x);
+                q[u]        = Ops::fmadd(x, x, q[u]);
+            }
+        }
+        for (; r < nRows; ++r)
+        {
+            const Vec x = Ops::sub(Ops::load(data + r * nCols + j, n), mv);
+            d[0]        = Ops::add(d[0], x);
+            q[0]        = Ops::fmadd(x, x, q[0]);
+        }
+        const Vec dv = Ops::add(Ops::add(d[0], d[1]), Ops::add(d[2], d[3]));
+        Ops::store(lanes[3], Ops::sub(Ops::add(Ops::add(q[0], q[1]), Ops::add(q[2], q[3])),
+                                      Ops::div(Ops::mul(dv, dv), rows)));
+
+        for (int l = 0; l < n; ++l)
+        {
+            mean[j + l] = lanes[0][l];
+            min[j + l]  = lanes[1][l];
+            max[j + l]  = lanes[2][l];
+            m2[j + l]   = lanes[3][l];
+        }
+    }
+}
+
+template <class Ops, class T>
+static inline void blockSimd(const T *data,
+                             size_t nRows,
+                             size_t nCols,
+                             double *mean,
+                             double *m2,
+                             double *min,
+                             double *max)
+{
+    if (nCols > (size_t)Ops::W)
+        return blockStrip<Ops, T>(data, nRows, nCols, mean, m2, min, max);
+
+    switch (nCols / gcd(nCols, Ops::W))
+    {
+        case 1:
+            return blockFlat<Ops, T, 1>(data, nRows, nCols, mean, m2, min, max);
+        case 3:
+            return blockFlat<Ops, T, 3>(data, nRows, nCols, mean, m2, min, max);
+        case 5:
+            return blockFlat<Ops, T, 5>(data, nRows, nCols, mean, m2, min, max);
+        default:
+            return blockFlat<Ops, T, 7>(data, nRows, nCols, mean, m2, min, max);
+    }
+}
+
+template <class T>
+__attribute__((target("avx2,fma"), flatten)) static void blockAvx2(const T *data,
+                                                                   size_t nRows,
+                                                                   size_t nCols,
+                                                                   double *mean,
+                                                                   double *m2,
+                                                                   double *min,
+                                                                   double *max)
+{
+    blockSimd<Avx2Ops, T>(data, nRows, nCols, mean, m2, min, max);
+}
+
+template <class T>
+__attribute__((target("avx512f"), flatten)) static void blockAvx512(const T *data,
+                                                                    size_t nRows,
+                                                                    size_t nCols,
+                                                                    double *mean,
+                                                                    double *m2,
+                                                                    double *min,
+                                                                    double *max)
+{
+    blockSimd<Avx512Ops, T>(data, nRows, nCols, mean, m2, min, max);
+}
+
+template <class T>
+static void blockStats(const T *data, size_t nRows, size_t nCols, double *mean, double *m2, double *min, double *max)
+{
+    static const bool avx512 = __builtin_cpu_supports("avx512f");
+    static const bool avx2   = __builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma");
+
+    if (avx512)
+        blockAvx512(data, nRows, nCols, mean, m2, min, max);
+    else if (avx2)
+        blockAvx2(data, nRows, nCols, mean, m2, min, max);
+    else
+        blockScalar(data, nRows, nCols, mean, m2, min, max);
+}
+
+void Stats_Moments::merge(const Stats_Moments &other)
+{
+    if (!other.count)
+        return;
+
+    chanMerge((double)this->count, this->mean, this->m2, (double)other.count, other.mean, other.m2);
+    this->count += other.count;
+    this->min = other.min < this->min ? other.min : this->min;
+    this->max = other.max > this->max ? other.max : this->max;
+}
+
+double Stats_Moments::getVariance(bool sample) const
+{
+    const uint64_t n = sample ? this->count - 1 : this->count;
+    return this->count > (uint64_t)sample ? this->m2 / n : NAN;
+}
+
+/// Scale function k1 of the t-digest, k(q) = delta / (2 pi) * asin(2q - 1)
+static inline double kScale(double q, double norm)
+{
+    return norm * asin(2 * q - 1);
+}
+
+static inline double kInverse(double k, double norm)
+{
+    return k >= norm * M_PI / 2 ? 1 : (sin(k / norm) + 1) / 2;
+}
+
+Stats_TDigest::Stats_TDigest(double compression)
+{
+    if (!(compression >= 10))
+        throw std::invalid_argument("t-digest compression has to be at least 10");
+
+    this->compression = compression;
+    this->buffer.reserve((size_t)(compression * (STATS_TDIGEST_BUFFER + 2)));
+    this->reset();
+}
+
+void Stats_TDigest::update(const double *data, size_t n)
+{
+    this->updateSamples(data, n);
+}
+
+void Stats_TDigest::update(const float *data, size_t n)
+{
+    this->updateSamples(data, n);
+}
+
+void Stats_TDigest::merge(const Stats_TDigest &other)
+{
+    if (!other.count)
+        return;
+
+    this->buffer.insert(this->buffer.end(), other.centroids.begin(), other.centroids.end());
+    this->count += other.count;
+    this->min = other.min < this->min ? other.min : this->min;
+    this->max = other.max > this->max ? other.max : this->max;
+    this->compress();
+}
+
+void Stats_TDigest::reset()
+{
+    this->count = 0;
+    this->min   = INFINITY;
+    this->max   = -INFINITY;
+    this->centroids.clear();
+    this->buffer.clear();
+}
+
+uint64_t Stats_TDigest::getCount() const
+{
+    return this->count;
+}
+
+double Stats_TDigest::getCompression() const
+{
+    return this->compression;
+}
+
+size_t Stats_TDigest::getCentroids() const
+{
+    return this->centroids.size();
+}
+
+double Stats_TDigest::getQuantile(double q) const
+{
+    if (!this->count)
+        return NAN;
+
+    const std::vector<Centroid> &c = this->centroids;
+    const double index             = (q < 0 ? 0 : q > 1 ? 1 : q) * this->count;
+
+    // Between min and the center of the first centroid
+    double soFar = c[0].weight / 2;
+    if (index <= soFar)
+        return this->min + index / soFar * (c[0].mean - this->min);
+
+    for (size_t i = 0; i + 1 < c.size(); ++i)
+    {
+        const double dw = (c[i].weight + c[i + 1].weight) / 2;
+        if (soFar + dw > index)
+            return c[i].mean + (index - soFar) / dw * (c[i + 1].mean - c[i].mean);
+        soFar += dw;
+    }
+
+    const Centroid &last = c.back();
+    const double t       = (index - soFar) / (last.weight / 2);
+    return last.mean + (t < 1 ? t : 1) * (this->max - last.mean);
+}
+
+template <class T>
+void Stats_TDigest::updateSamples(const T *data, size_t n)
+{
+    const size_t capacity = (size_t)(this->compression * STATS_TDIGEST_BUFFER);
+
+    for (size_t i = 0; i < n; ++i)
+    {
+        const double x = data[i];
+        if (x != x)
+            continue;
+
+        this->buffer.push_back({x, 1});
+        this->min = x < this->min ? x : this->min;
+        this->max = x > this->max ? x : this->max;
+        ++this->count;
+        if (this->buffer.size() >= capacity)
+            this->compress();
+    }
+    this->compress();
+}
+
+/// Merges buffered samples and centroids in one sorted pass, a centroid grows while it spans less than one k unit
+void Stats_TDigest::compress()
+{
+    if (this->buffer.empty())
+        return;
+
+    std::vector<Centroid> &all = this->buffer;
+    all.insert(all.end(), this->centroids.begin(), this->centroids.end());
+    std::sort(all.begin(), all.end(), [](const Centroid &a, const Centroid &b) { return a.mean < b.mean; });
+
+    const double total = (double)this->count;
+    const double norm  = this->compression / (2 * M_PI);
+    double soFar       = 0;
+    double limit       = total * kInverse(kScale(0, norm) + 1, norm);
+    Centroid current   = all[0];
+
+    this->centroids.clear();
+    for (size_t i = 1; i < all.size(); ++i)
+    {
+        if (soFar + current.weight + all[i].weight <= limit)
+        {
+            current.weight += all[i].weight;
+            current.mean += (all[i].mean - current.mean) * all[i].weight / current.weight;
+            continue;
+        }
+
+        soFar += current.weight;
+        this->centroids.push_back(current);
+        limit   = total * kInverse(kScale(soFar / total, norm) + 1, norm);
+        current = all[i];
+    }
+    this->centroids.push_back(current);
+    all.clear();
+}
+
+/// Slot of a sample, out of range and NaN values are clamped in the same order as the SIMD min/max
+template <class T>
+static void histScalar(const T *data, size_t n, double low, double scale, size_t nBins, uint64_t *counts)
+{
+    const double top = (double)(nBins + 1);
+
+    for (size_t i = 0; i < n; ++i)
+    {
+        double y = (data[i] - low) * scale + 1;
+        y        = y > 0 ? y : 0;
+        y        = y < top ? y : top;
+        ++counts[(size_t)y * STATS_HIST_COPIES + (i & (STATS_HIST_COPIES - 1))];
+    }
+}
+
+template <class T>
+__attribute__((target("avx2,fma"), flatten)) static void histAvx2(const T *data,
+                                                                  size_t n,
+                                                                  double low,
+                                                                  double scale,
+                                                                  size_t nBins,
+                                                                  uint64_t *counts)
+{
+    const __m256d vLow   = _mm256_set1_pd(low);
+    const __m256d vScale = _mm256_set1_pd(scale);
+    const __m256d one    = _mm256_set1_pd(1);
+    const __m256d top    = _mm256_set1_pd((double)(nBins + 1));
+    alignas(16) int32_t idx[4];
+    size_t i = 0;
+
+    for (; i + 4 <= n; i += 4)
+    {
+        __m256d y = _mm256_add_pd(_mm256_mul_pd(_mm256_sub_pd(Avx2Ops::load(data + i).v, vLow), vScale), one);
+        y         = _mm256_min_pd(_mm256_max_pd(y, _mm256_setzero_pd()), top);
+        _mm_store_si128((__m128i *)idx, _mm256_cvttpd_epi32(y));
+        for (int l = 0; l < 4; ++l)
+            ++counts[idx[l] * STATS_HIST_COPIES + l];
+    }
+    histScalar(data + i, n - i, low, scale, nBins, counts);
+}
+
+template <class T>
+__attribute__((target("avx512f"), flatten)) static void histAvx512(const T *data,
+                                                                   size_t n,
+                                                                   double low,
+                                                                   double scale,
+                                                                   size_t nBins,
+                                                                   uint64_t *counts)
+{
+    const __m512d vLow   = _mm512_set1_pd(low);
+    const __m512d vScale = _mm512_set1_pd(scale);
+    const __m512d one    = _mm512_set1_pd(1);
+    const __m512d top    = _mm512_set1_pd((double)(nBins + 1));
+    alignas(32) int32_t idx[8];
+    size_t i = 0;
+
+    for (; i + 8 <= n; i += 8)
+    {
+        __m512d y = _mm512_add_pd(_mm512_mul_pd(_mm512_sub_pd(Avx512Ops::load(data + i).v, vLow), vScale), one);
+        y         = _mm512_maskz_min_pd(0xff, _mm512_maskz_max_pd(0xff, y, _mm512_setzero_pd()), top);
+        _mm256_store_si256((__m256i *)idx, _mm512_maskz_cvttpd_epi32(0xff, y));
+        for (int l = 0; l < 8; ++l)
+            ++counts[idx[l] * STATS_HIST_COPIES + (l & (STATS_HIST_COPIES - 1))];
+    }
+    histScalar(data + i, n - i, low, scale, nBins, counts);
+}
+
+template <class T>
+static void histStats(const T *data, size_t n, double low, double scale, size_t nBins, uint64_t *counts)
+{
+    static const bool avx512 = __builtin_cpu_supports("avx512f");
+    static const bool avx2   = __builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma");
+
+    if (avx512)
+        histAvx512(data, n, low, scale, nBins, counts);
+    else if (avx2)
+        histAvx2(data, n, low, scale, nBins, counts);
+    else
+        histScalar(data, n, low, scale, nBins, counts);
+}
+
+Stats_Histogram::Stats_Histogram(double low, double high, size_t nBins)
+{
+    if (!(high > low) || !nBins || nBins > INT32_MAX - 2)
+        throw std::invalid_argument("Invalid histogram range or number of bins");
+
+    this->low   = low;
+    this->high  = high;
+    this->nBins = nBins;
+    this->scale = nBins / (high - low);
+    this->counts.assign((nBins + 2) * STATS_HIST_COPIES, 0);
+}
+
+void Stats_Histogram::update(const double *data, size_t n)
+{
+    histStats(data, n, this->low, this->scale, this->nBins, this->counts.data());
+}
+
+void Stats_Histogram::update(const float *data, size_t n)
+{
+    histStats(data, n, this->low, this->scale, this->nBins, this->counts.data());
+}
+
+void Stats_Histogram::merge(const Stats_Histogram &other)
+{
+    if (other.low != this->low || other.high != this->high || other.nBins != this->nBins)
+        throw std::invalid_argument("Histograms have different bins");
+
+    for (size_t i = 0; i < this->counts.size(); ++i)
+        this->counts[i] += other.counts[i];
+}
+
+void Stats_Histogram::reset()
+{
+    std::fill(this->counts.begin(), this->counts.end(), 0);
+}
+
+size_t Stats_Histogram::getBins() const
+{
+    return this->nBins;
+}
+
+double Stats_Histogram::getLow() const
+{
+    return this->low;
+}
+
+double Stats_Histogram::getHigh() const
+{
+    return this->high;
+}
+
+uint64_t Stats_Histogram::getCount(size_t bin) const
+{
+    if (bin >= this->nBins)
+        throw std::out_of_range("Histogram bin out of range");
+    return this->slotCount(bin + 1);
+}
+
+uint64_t Stats_Histogram::getUnderflow() const
+{
+    return this->slotCount(0);
+}
+
+uint64_t Stats_Histogram::getOverflow() const
+{
+    return this->slotCount(this->nBins + 1);
+}
+
+uint64_t Stats_Histogram::getTotal() const
+{
+    uint64_t total = 0;
+    for (uint64_t c : this->counts)
+        total += c;
+    return total;
+}
+
+double Stats_Histogram::getQuantile(double q) const
+{
+    const uint64_t total = this->getTotal();
+    if (!total)
+        return NAN;
+
+    const double index = (q < 0 ? 0 : q > 1 ? 1 : q) * total;
+    double soFar       = (double)this->slotCount(0);
+    if (index <= soFar)
+        return this->low;
+
+    for (size_t bin = 0; bin < this->nBins; ++bin)
+    {
+        const double c = (double)this->slotCount(bin + 1);
+        if (c && soFar + c >= index)
+            return this->low + (bin + (index - soFar) / c) / this->scale;
+        soFar += c;
+    }
+
+    return this->high;
+}
+
+uint64_t Stats_Histogram::slotCount(size_t slot) const
+{
+    uint64_t count = 0;
+    for (int k = 0; k < STATS_HIST_COPIES; ++k)
+        count += this->counts[slot * STATS_HIST_COPIES + k];
+    return count;
+}
+
+Stats_Accumulator::Stats_Accumulator(size_t nColumns)
+{
+    if (!nColumns)
+        throw std::invalid_argument("At least one column is required");
+
+    // Every block but the last of an update starts the lane pattern of the widest kernel at column 0
+    const size_t period = nColumns / gcd(nColumns, STATS_MAX_LANES) * STATS_MAX_LANES;
+    const size_t blocks = STATS_BLOCK_ELEMENTS / period;
+    this->nColumns      = nColumns;
+    this->blockRows     = (blocks ? blocks : 1) * period / nColumns;
+    this->block.resize(4 * nColumns);
+    this->reset();
+}
+
+void Stats_Accumulator::update(const double *data, size_t nRows)
+{
+    this->updateBlocks(data, nRows);
+}
+
+void Stats_Accumulator::update(const float *data, size_t nRows)
+{
+    this->updateBlocks(data, nRows);
+}
+
+void Stats_Accumulator::updateParallel(const double *data, size_t nRows, int nThreads)
+{
+    this->updateThreads(data, nRows, nThreads);
+}
+
+void Stats_Accumulator::updateParallel(const float *data, size_t nRows, int nThreads)
+{
+    this->updateThreads(data, nRows, nThreads);
+}
+
+void Stats_Accumulator::merge(const Stats_Accumulator &other)
+{
+    if (other.nColumns != this->nColumns || other.digests.size() != this->digests.size() ||
+        other.histograms.size() != this->histograms.size())
+        throw std::invalid_argument("Accumulators have different columns or sketches");
+    if (!other.count)
+        return;
+
+    for (size_t c = 0; c < this->digests.size(); ++c)
+        this->digests[c].merge(other.digests[c]);
+    for (size_t c = 0; c < this->histograms.size(); ++c)
+        this->histograms[c].merge(other.histograms[c]);
+
+    const double nA = (double)this->count, nB = (double)other.count;
+    for (size_t c = 0; c < this->nColumns; ++c)
+    {
+        chanMerge(nA, this->mean[c], this->m2[c], nB, other.mean[c], other.m2[c]);
+        this->min[c] = other.min[c] < this->min[c] ? other.min[c] : this->min[c];
+        this->max[c] = other.max[c] > this->max[c] ? other.max[c] : this->max[c];
+    }
+    this->count += other.count;
+}
+
+void Stats_Accumulator::reset()
+{
+    this->count = 0;
+    this->mean.assign(this->nColumns, 0.0);
+    this->m2.assign(this->nColumns, 0.0);
+    this->min.assign(this->nColumns, INFINITY);
+    this->max.assign(this->nColumns, -INFINITY);
+    for (Stats_TDigest &digest : this->digests)
+        digest.reset();
+    for (Stats_Histogram &histogram : this->histograms)
+        histogram.reset();
+}
+
+void Stats_Accumulator::enableQuantiles(double compression)
+{
+    this->digests.assign(this->nColumns, Stats_TDigest(compression));
+}
+
+void Stats_Accumulator::enableHistogram(double low, double high, size_t nBins)
+{
+    this->histograms.assign(this->nColumns, Stats_Histogram(low, high, nBins));
+}
+
+size_t Stats_Accumulator::getColumns() const
+{
+    return this->nColumns;
+}
+
+uint64_t Stats_Accumulator::getCount() const
+{
+    return this->count;
+}
+
+double Stats_Accumulator::getMin(size_t column) const
+{
+    return this->min.at(column);
+}
+
+double Stats_Accumulator::getMax(size_t column) const
+{
+    return this->max.at(column);
+}
+
+double Stats_Accumulator::getMean(size_t column) const
+{
+    return this->count ? this->mean.at(column) : NAN;
+}
+
+double Stats_Accumulator::getVariance(size_t column, bool sample) const
+{
+    const uint64_t n = sample ? this->count - 1 : this->count;
+    return this->count > (uint64_t)sample ? this->m2.at(column) / n : NAN;
+}
+
+double Stats_Accumulator::getStd(size_t column, bool sample) const
+{
+    return sqrt(this->getVariance(column, sample));
+}
+
+Stats_Moments Stats_Accumulator::getMoments(size_t column) const
+{
+    Stats_Moments moments;
+
+    moments.count = this->count;
+    moments.mean  = this->mean.at(column);
+    moments.m2    = this->m2.at(column);
+    moments.min   = this->min.at(column);
+    moments.max   = this->max.at(column);
+    return moments;
+}
+
+double Stats_Accumulator::getQuantile(size_t column, double q) const
+{
+    return this->getDigest(column).getQuantile(q);
+}
+
+const Stats_TDigest &Stats_Accumulator::getDigest(size_t column) const
+{
+    if (this->digests.empty())
+        throw std::runtime_error("Quantiles are not enabled");
+    return this->digests.at(column);
+}
+
+const Stats_Histogram &Stats_Accumulator::getHistogram(size_t column) const
+{
+    if (this->histograms.empty())
+        throw std::runtime_error("Histograms are not enabled");
+    return this->histograms.at(column);
+}
+
+/// Accumulator with the same columns and sketch settings but no samples
+Stats_Accumulator Stats_Accumulator::emptyCopy() const
+{
+    Stats_Accumulator copy(this->nColumns);
+
+    if (!this->digests.empty())
+        copy.enableQuantiles(this->digests[0].getCompression());
+    if (!this->histograms.empty())
+    {
+        const Stats_Histogram &histogram = this->histograms[0];
+        copy.enableHistogram(histogram.getLow(), histogram.getHigh(), histogram.getBins());
+    }
+    return copy;
+}
+
+template <class T>
+void Stats_Accumulator::updateBlocks(const T *data, size_t nRows)
+{
+    const size_t nCols = this->nColumns;
+    double *bMean      = this->block.data();
+    double *bM2        = bMean + nCols;
+    double *bMin       = bM2 + nCols;
+    double *bMax       = bMin + nCols;
+
+    for (size_t r = 0; r < nRows; r += this->blockRows)
+    {
+        const size_t rows = nRows - r < this->blockRows ? nRows - r : this->blockRows;
+        blockStats(data + r * nCols, rows, nCols, bMean, bM2, bMin, bMax);
+
+        const double nA = (double)this->count, nB = (double)rows;
+        for (size_t c = 0; c < nCols; ++c)
+        {
+            chanMerge(nA, this->mean[c], this->m2[c], nB, bMean[c], bM2[c]);
+            this->min[c] = bMin[c] < this->min[c] ? bMin[c] : this->min[c];
+            this->max[c] = bMax[c] > this->max[c] ? bMax[c] : this->max[c];
+        }
+        this->count += rows;
+
+        if (!this->digests.empty() || !this->histograms.empty())
+            this->updateSketches(data + r * nCols, rows);
+    }
+}
+
+/// Sketches take contiguous samples, columns of interleaved rows are gathered from the block while it is in cache
+template <class T>
+void Stats_Accumulator::updateSketches(const T *data, size_t nRows)
+{
+    const size_t nCols = this->nColumns;
+
+    if (nCols == 1)
+    {
+        if (!this->digests.empty())
+            this->digests[0].update(data, nRows);
+        if (!this->histograms.empty())
+            this->histograms[0].update(data, nRows);
+        return;
+    }
+
+    this->column.resize(nRows);
+    for (size_t c = 0; c < nCols; ++c)
+    {
+        for (size_t r = 0; r < nRows; ++r)
+            this->column[r] = data[r * nCols + c];
+        if (!this->digests.empty())
+            this->digests[c].update(this->column.data(), nRows);
+        if (!this->histograms.empty())
+            this->histograms[c].update(this->column.data(), nRows);
+    }
+}
+
+template <class T>
+void Stats_Accumulator::updateThreads(const T *data, size_t nRows, int nThreads)
+{
+    const size_t nBlocks = (nRows + this->blockRows - 1) / this->blockRows;
+
+    nThreads = nThreads > 0 ? nThreads : omp_get_max_threads();
+    if ((size_t)nThreads > nBlocks)
+        nThreads = (int)nBlocks;
+    if (nThreads < 2)
+        return this->updateBlocks(data, nRows);
+
+    std::vector<Stats_Accumulator> parts(nThreads, this->emptyCopy());
+#pragma omp parallel num_threads(nThreads)
+    {
+        // Team may be smaller than requested, unused parts stay empty
+        const size_t t     = omp_get_thread_num();
+        const size_t nTeam = omp_get_num_threads();
+        const size_t first = nBlocks * t / nTeam * this->blockRows;
+        const size_t last  = nBlocks * (t + 1) / nTeam * this->blockRows;
+
+        parts[t].updateBlocks(data + first * this->nColumns, (last < nRows ? last : nRows) - first);
+    }
+
+    for (const Stats_Accumulator &part : parts)
+        this->merge(part);
+}
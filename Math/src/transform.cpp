@@ -74,6 +74,26 @@ cleanup:
     return status;
 }
 
+IppStatus calchilbert(IppsHilbertSpec *hilbert, Ipp8u *pBuffer, const float *data, float *output, const size_t wlen)
+{
+    IppStatus status = ippStsNoErr;
+    Ipp32fc *hbuff   = (Ipp32fc *)mkl_malloc(sizeof(Ipp32fc) * wlen, 64);
+
+    if (hbuff == NULL)
+    {    // Check allocated memory
+        return ippStsNoMemErr;
+    }
+
+    status = ippsHilbertInit_32f32fc(wlen, ippAlgHintNone, hilbert, pBuffer);    // Initialize
+    if (status == ippStsNoErr)
+        status = ippsHilbert_32f32fc(data, hbuff, hilbert, pBuffer);    // Hilbert transform
+    if (status == ippStsNoErr)
+        status = ippsImag_32fc(hbuff, output, wlen);    // Get imaginary part
+
+    mkl_free(hbuff);
+    return status;
+}
+
 long createFFT_MKL(DFTI_DESCRIPTOR_HANDLE *fft, const int wlen)
 {
     long status = DFTI_NO_ERROR;
@@ -127,131 +147,429 @@ cleanup:
     return out;
 }
 
+IppStatus createFFT_IPP(IppsDFTSpec_R_32f *&spec, Ipp8u *&pBuffer, const int wlen)
+{
+    IppStatus status = ippStsNoErr;
+    int sizeSpec, sizeInit, sizeBuf;
+    Ipp8u *init = NULL;
+
+    spec    = NULL;
+    pBuffer = NULL;
+    status  = ippsDFTGetSize_R_32f(wlen, IPP_FFT_DIV_FWD_BY_N, ippAlgHintNone, &sizeSpec, &sizeInit, &sizeBuf);
+    if (status != ippStsNoErr)
+        return status;
+
+    // Configure descriptor, scale 1/wlen like the MKL path
+    spec    = (IppsDFTSpec_R_32f *)ippsMalloc_8u(sizeSpec);
+    pBuffer = ippsMalloc_8u(sizeBuf > 0 ? sizeBuf : 1);
+    init    = ippsMalloc_8u(sizeInit > 0 ? sizeInit : 1);
+    if (spec == NULL || pBuffer == NULL || init == NULL)
+        status = ippStsNoMemErr;
+    else
+        status = ippsDFTInit_R_32f(wlen, IPP_FFT_DIV_FWD_BY_N, ippAlgHintNone, spec, init);
+
+    ippsFree(init);
+    if (status != ippStsNoErr)
+    {
+        ippsFree(spec);
+        ippsFree(pBuffer);
+        spec    = NULL;
+        pBuffer = NULL;
+    }
+
+    return status;
+}
+
+IppStatus calculateFFT_IPP(const IppsDFTSpec_R_32f *spec,
+                           Ipp8u *pBuffer,
+                           const float *data,
+                           const float *window,
+                           float *frame,
+                           Ipp32fc *spectrum,
+                           const int wlen)
+{
+    IppStatus status = ippsMul_32f(data, window, frame, wlen);    // Multiply with window
+    if (status != ippStsNoErr)
+        return status;
+
+    // CCS packing, bin k at floats 2k and 2k + 1, the wlen + 2 floats of wlen / 2 + 1 complex values
+    return ippsDFTFwd_RToCCS_32f(frame, (Ipp32f *)spectrum, spec, pBuffer);
+}
+
 long spectrogram(double* data, int dataLen, double*** output, double* window, int wlen, int overlap, int bits)
 {
-	long status = DFTI_NO_ERROR;			// Error descriptor	
+	long status = DFTI_NO_ERROR;
+	double **out = NULL;
+	*output = NULL;
 
-	int nth = MKL_Set_Num_Threads_Local(1);		// Set MKL thread to 1
-	int max_thread = omp_get_max_threads();		// Get max thread num
-	
-	int shift = wlen - overlap;
-	int outLen = floor((dataLen - wlen) / (shift)) + 1;
-	DFTI_DESCRIPTOR_HANDLE *vfft = (DFTI_DESCRIPTOR_HANDLE *)MKL_malloc(max_thread * sizeof(DFTI_DESCRIPTOR_HANDLE), 64);	// FFT Descriptors
+	try {
+		Spectrogram spec(window, wlen, overlap, bits);
+		status = spec.compute(data, dataLen);
+		if (status)
+			return status;
 
-	// Init output	
-	double **out = (double**)MKL_malloc(outLen * sizeof(double*), 64);
-	if (!(out && vfft)) { // Check allocated memory
-		status = DFTI_MEMORY_ERROR;
-		goto cleanup;
-	}
-	for (int i = 0; i < outLen; ++i) {
-		out[i] = (double*)MKL_malloc((wlen / 2 + 1) * sizeof(double), 64);
-		if (!out[i]) { // Check allocated memory
-			status = DFTI_MEMORY_ERROR;
-			goto cleanup;
+		// Copy to separately allocated rows
+		const size_t outLen = spec.getOutputFrames();
+		const int bins = spec.getBins();
+		if (!outLen) // Shorter than one window, MKL_malloc(0) may return NULL
+			return DFTI_NO_ERROR;
+		out = (double**)MKL_malloc(outLen * sizeof(double*), 64);
+		if (!out)
+			return DFTI_MEMORY_ERROR;
+		for (size_t i = 0; i < outLen; ++i) {
+			out[i] = (double*)MKL_malloc(bins * sizeof(double), 64);
+			if (!out[i]) { // Check allocated memory
+				for (size_t j = 0; j < i; ++j)
+					MKL_free(out[j]);
+				MKL_free(out);
+				return DFTI_MEMORY_ERROR;
+			}
+			memcpy(out[i], spec.getOutput() + i * bins, bins * sizeof(double));
 		}
 	}
-
-	// Init FFT
-	for (int i = 0; i < max_thread; ++i) {
-		status = createFFT_MKL(&vfft[i], wlen);
-		if (status && !DftiErrorClass(status, DFTI_NO_ERROR)) {
-			goto cleanup;
-		}
+	catch (const std::invalid_argument &) {
+		return DFTI_INVALID_CONFIGURATION;
+	}
+	catch (const std::exception &) {
+		return DFTI_MEMORY_ERROR;
 	}
 
-	// Compute FFT
-	#pragma omp parallel for
-	for (int i = 0; i < outLen; ++i) {
-		if (!status) {
-			IppStatus status_local = DFTI_NO_ERROR;
-			int id = omp_get_thread_num();
-
-			double* ptr = NULL;
-			double* buff = (double*)MKL_malloc(wlen * sizeof(double), 64);
-			MKL_Complex16* fdata = (MKL_Complex16*)MKL_malloc((wlen / 2 + 1) * sizeof(MKL_Complex16), 64);
-			if (!(buff && fdata)) {	// Check memory
-				#pragma omp critical
-				status = DFTI_MEMORY_ERROR;
-				continue;
-			}
+	*output = out;
+	return status;
+}
 
-			vdMul(wlen, &data[i*shift], window, buff);	// Multiply with window
-			if (status_local = vmlGetErrStatus(), status_local) {
-				#pragma omp critical
-				status = status_local;
-				continue;
-			}
+/**
+ * Magnitude in dB, 20 * log10(|X| + eps) + offset clamped at DBLIMIT.
+ *
+ * Three passes over a row which stays in L1. The log is the vectorized VML kernel, which only works on whole arrays,
+ * fusing it with the magnitude and the clamp would mean a scalar log10 per bin, slower than the extra passes.
+ */
+static void magnitudeDb(const MKL_Complex16 *spectrum, double *out, int n, double offset)
+{
+    for (int j = 0; j < n; ++j)
+        out[j] = sqrt(spectrum[j].real * spectrum[j].real + spectrum[j].imag * spectrum[j].imag) + SPEC_EPS;
 
-			status_local = DftiCommitDescriptor(vfft[id]); // Commit DFT
-			if (status_local && !DftiErrorClass(status_local, DFTI_NO_ERROR)) {
-				#pragma omp critical
-				status = status_local;
-				continue;
-			}
+    vdLog10(n, out, out);
 
-			status_local = DftiComputeForward(vfft[id], buff, fdata); // Compute DFT
-			if (status_local && !DftiErrorClass(status_local, DFTI_NO_ERROR)) {
-				#pragma omp critical
-				status = status_local;
-				continue;
-			}
+    for (int j = 0; j < n; ++j)
+    {
+        const double db = 20 * out[j] + offset;
+        out[j]          = db > DBLIMIT ? db : DBLIMIT;
+    }
+}
 
-			vzAbs(wlen / 2 + 1, fdata, out[i]); // Find magnitude
-			if (status_local = vmlGetErrStatus(), status_local) {
-				#pragma omp critical
-				status = status_local;
-				continue;
-			}
+static void magnitudeDb(const Ipp32fc *spectrum, float *out, int n, float offset)
+{
+    for (int j = 0; j < n; ++j)
+        out[j] = sqrtf(spectrum[j].re * spectrum[j].re + spectrum[j].im * spectrum[j].im) + (float)SPEC_EPS;
 
-			status_local = ippsAddC_64f_I(0.0001, out[i], wlen / 2 + 1); // Add eps
-			if (status_local)
-			{
-				#pragma omp critical
-				status = status_local;
-				continue;
-			}
+    vsLog10(n, out, out);
 
-			cblas_dscal(wlen / 2 + 1, pow(2, -bits), out[i], 1); // Normalize
-			vdLog10(wlen / 2 + 1, out[i], out[i]); // Log
-			if (status_local = vmlGetErrStatus(), status_local) {
-				#pragma omp critical
-				status = status_local;
-				continue;
-			}
-			cblas_dscal(wlen / 2 + 1, 20, out[i], 1); // Multiply 20
-
-			ptr = out[i];
-			for (int j = 0; j < wlen / 2 + 1; ++j) {
-				if (ptr[j] < DBLIMIT)
-					ptr[j] = DBLIMIT;
-			}			
-
-			// Free buffers
-			MKL_free(fdata);
-			MKL_free(buff);
-		}		
-	}
+    for (int j = 0; j < n; ++j)
+    {
+        const float db = 20 * out[j] + offset;
+        out[j]         = db > DBLIMIT ? db : DBLIMIT;
+    }
+}
 
-	if (max_thread == 1)	// All PCs have more than 1 thread if it is 1 there is a problem (Assume as warning)
-		status = DFTI_MULTITHREADED_ERROR;
-	
-cleanup:
-	MKL_Set_Num_Threads_Local(nth); // Set thread to default
-	if (status) {
-		for (int i = 0; i < outLen; ++i)
-			MKL_free(out[i]);
-		MKL_free(out);
-		out = NULL;
-	}
-	*output = out;
+Spectrogram::Spectrogram(const double *window, int wlen, int overlap, int bits, int nThreads)
+{
+    if (!window || wlen < 2 || overlap < 0 || overlap >= wlen)
+        throw std::invalid_argument("Invalid window or overlap");
 
-	// Release FFT
-	for (int i = 0; i < max_thread; ++i)
-		status = DftiFreeDescriptor(&vfft[i]);
-	MKL_free(vfft);
+    this->wlen           = wlen;
+    this->shift          = wlen - overlap;
+    this->bins           = wlen / 2 + 1;
+    this->nThreads       = nThreads > 0 ? nThreads : omp_get_max_threads();
+    this->frameStride    = (wlen + 7) & ~7;
+    this->spectrumStride = (this->bins + 3) & ~3;
+    this->offset         = -20.0 * bits * log10(2.0);
 
-	return status;
+    const size_t threads = this->nThreads;
+    this->window         = (double *)MKL_malloc(wlen * sizeof(double), 64);
+    this->frames         = (double *)MKL_malloc(threads * this->frameStride * sizeof(double), 64);
+    this->spectra        = (MKL_Complex16 *)MKL_malloc(threads * this->spectrumStride * sizeof(MKL_Complex16), 64);
+    if (!(this->window && this->frames && this->spectra))
+    {
+        this->release();
+        throw std::runtime_error("Can not allocate spectrogram buffers");
+    }
+    memcpy(this->window, window, wlen * sizeof(double));
+
+    this->plans.assign(this->nThreads, nullptr);
+    for (int i = 0; i < this->nThreads; ++i)
+    {
+        long status = createFFT_MKL(&this->plans[i], wlen);
+        if (!status)
+            status = DftiCommitDescriptor(this->plans[i]);
+        if (status && !DftiErrorClass(status, DFTI_NO_ERROR))
+        {
+            this->release();
+            throw std::runtime_error("Can not create FFT descriptor");
+        }
+    }
+}
+
+long Spectrogram::compute(const double *data, size_t dataLen, double *output)
+{
+    const long long nFrames = (long long)this->getFrames(dataLen);
+    long long first         = 0;
+
+    if (!nFrames)
+        return DFTI_NO_ERROR;
+    if (!data || !output)
+        return DFTI_INVALID_CONFIGURATION;
+
+    for (; this->batchFrames && first + this->batchFrames <= nFrames; first += this->batchFrames)
+    {
+        const long status = this->computeBlock(&data[first * this->shift], &output[first * this->bins]);
+        if (status)
+            return status;
+    }
+
+    return this->computeFrames(data, first, nFrames, output);
+}
+
+long Spectrogram::compute(const double *data, size_t dataLen)
+{
+    const size_t nFrames = this->getFrames(dataLen);
+
+    if (nFrames > this->capacity)
+    {
+        double *grown = (double *)MKL_malloc(nFrames * this->bins * sizeof(double), 64);
+        if (!grown)
+            return DFTI_MEMORY_ERROR;
+        MKL_free(this->output);
+        this->output   = grown;
+        this->capacity = nFrames;
+    }
+
+    this->outputFrames = 0;
+    const long status  = this->compute(data, dataLen, this->output);
+    if (!status)
+        this->outputFrames = nFrames;
+
+    return status;
+}
+
+long Spectrogram::computeComplex(const double *data, size_t dataLen, MKL_Complex16 *output)
+{
+    const long long nFrames = (long long)this->getFrames(dataLen);
+    long status             = DFTI_NO_ERROR;
+
+    if (!nFrames)
+        return DFTI_NO_ERROR;
+    if (!data || !output)
+        return DFTI_INVALID_CONFIGURATION;
+
+    const int nth = MKL_Set_Num_Threads_Local(1);    // Frames are the parallel dimension
+#pragma omp parallel for num_threads(this->nThreads) schedule(static)
+    for (long long i = 0; i < nFrames; ++i)
+    {
+        if (status)
+            continue;
+
+        const long local = this->spectrum(&data[i * this->shift], &output[i * this->bins], omp_get_thread_num());
+        if (local)
+        {
+#pragma omp critical
+            status = local;
+        }
+    }
+    MKL_Set_Num_Threads_Local(nth);
+
+    return status;
+}
+
+long Spectrogram::spectrum(const double *data, MKL_Complex16 *output, int thread)
+{
+    if (thread < 0 || thread >= this->nThreads)
+        return DFTI_INVALID_CONFIGURATION;
+
+    double *frame = &this->frames[(size_t)thread * this->frameStride];
+    vdMul(this->wlen, data, this->window, frame);    // Multiply with window
+
+    const long status = DftiComputeForward(this->plans[thread], frame, output);    // Compute DFT
+    if (status && !DftiErrorClass(status, DFTI_NO_ERROR))
+        return status;
+    return DFTI_NO_ERROR;
+}
+
+long Spectrogram::transform(const double *data, double *output, int thread)
+{
+    if (thread < 0 || thread >= this->nThreads)
+        return DFTI_INVALID_CONFIGURATION;
+
+    double *frame           = &this->frames[(size_t)thread * this->frameStride];
+    MKL_Complex16 *spectrum = &this->spectra[(size_t)thread * this->spectrumStride];
+
+    vdMul(this->wlen, data, this->window, frame);    // Multiply with window
+
+    const long status = DftiComputeForward(this->plans[thread], frame, spectrum);    // Compute DFT
+    if (status && !DftiErrorClass(status, DFTI_NO_ERROR))
+        return status;
+
+    magnitudeDb(spectrum, output, this->bins, this->offset);
+    return DFTI_NO_ERROR;
+}
+
+long Spectrogram::setBatch(int batchFrames)
+{
+    long status = DFTI_NO_ERROR;
+
+    this->releaseBatch();
+    if (batchFrames <= 0)
+        return DFTI_NO_ERROR;
+
+    const size_t frames = batchFrames;
+    this->batchInput    = (double *)MKL_malloc(frames * this->frameStride * sizeof(double), 64);
+    this->batchSpectra  = (MKL_Complex16 *)MKL_malloc(frames * this->spectrumStride * sizeof(MKL_Complex16), 64);
+    if (!(this->batchInput && this->batchSpectra))
+    {
+        this->releaseBatch();
+        return DFTI_MEMORY_ERROR;
+    }
+
+    status = createFFT_MKL(&this->batchPlan, this->wlen);
+    if (!status)
+        status = DftiSetValue(this->batchPlan, DFTI_NUMBER_OF_TRANSFORMS, (MKL_LONG)batchFrames);
+    if (!status)
+        status = DftiSetValue(this->batchPlan, DFTI_INPUT_DISTANCE, (MKL_LONG)this->frameStride);    // Real values
+    if (!status)
+        status = DftiSetValue(this->batchPlan, DFTI_OUTPUT_DISTANCE, (MKL_LONG)this->spectrumStride);    // Complex
+    if (!status)
+        status = DftiSetValue(this->batchPlan, DFTI_THREAD_LIMIT, (MKL_LONG)this->nThreads);
+    if (!status)
+        status = DftiCommitDescriptor(this->batchPlan);
+    if (status && !DftiErrorClass(status, DFTI_NO_ERROR))
+    {
+        this->releaseBatch();
+        return status;
+    }
+
+    this->batchFrames = batchFrames;
+    return DFTI_NO_ERROR;
+}
+
+size_t Spectrogram::getFrames(size_t dataLen) const
+{
+    return dataLen < (size_t)this->wlen ? 0 : (dataLen - this->wlen) / this->shift + 1;
+}
+
+int Spectrogram::getBins() const
+{
+    return this->bins;
+}
+
+int Spectrogram::getWindowLength() const
+{
+    return this->wlen;
+}
+
+int Spectrogram::getShift() const
+{
+    return this->shift;
+}
+
+int Spectrogram::getBatch() const
+{
+    return this->batchFrames;
+}
+
+const double *Spectrogram::getOutput() const
+{
+    return this->output;
+}
+
+size_t Spectrogram::getOutputFrames() const
+{
+    return this->outputFrames;
+}
+
+Spectrogram::~Spectrogram()
+{
+    this->release();
+}
+
+/// Frames [first, last) with one DFTI call per frame, frames are the parallel dimension
+long Spectrogram::computeFrames(const double *data, long long first, long long last, double *output)
+{
+    long status = DFTI_NO_ERROR;
+
+    const int nth = MKL_Set_Num_Threads_Local(1);
+#pragma omp parallel for num_threads(this->nThreads) schedule(static)
+    for (long long i = first; i < last; ++i)
+    {
+        if (status)
+            continue;
+
+        const long local = this->transform(&data[i * this->shift], &output[i * this->bins], omp_get_thread_num());
+        if (local)
+        {
+#pragma omp critical
+            status = local;
+        }
+    }
+    MKL_Set_Num_Threads_Local(nth);
+
+    return status;
+}
+
+/// batchFrames frames with a single DFTI call, windowing and dB conversion run in parallel around it
+long Spectrogram::computeBlock(const double *data, double *output)
+{
+    const int nth = MKL_Set_Num_Threads_Local(1);
+#pragma omp parallel for num_threads(this->nThreads) schedule(static)
+    for (int f = 0; f < this->batchFrames; ++f)
+    {
+        double *frame = &this->batchInput[(size_t)f * this->frameStride];
+        vdMul(this->wlen, &data[(size_t)f * this->shift], this->window, frame);    // Multiply with window
+    }
+    MKL_Set_Num_Threads_Local(nth);
+
+    const long status = DftiComputeForward(this->batchPlan, this->batchInput, this->batchSpectra);    // Compute DFTs
+    if (status && !DftiErrorClass(status, DFTI_NO_ERROR))
+        return status;
+
+#pragma omp parallel for num_threads(this->nThreads) schedule(static)
+    for (int f = 0; f < this->batchFrames; ++f)
+        magnitudeDb(&this->batchSpectra[(size_t)f * this->spectrumStride], &output[(size_t)f * this->bins], this->bins,
+                    this->offset);
+
+    return DFTI_NO_ERROR;
+}
+
+void Spectrogram::releaseBatch()
+{
+    if (this->batchPlan)
+        DftiFreeDescriptor(&this->batchPlan);
+    MKL_free(this->batchInput);
+    MKL_free(this->batchSpectra);
+    this->batchPlan    = nullptr;
+    this->batchInput   = nullptr;
+    this->batchSpectra = nullptr;
+    this->batchFrames  = 0;
+}
+
+void Spectrogram::release()
+{
+    this->releaseBatch();
+    for (DFTI_DESCRIPTOR_HANDLE &plan : this->plans)
+    {
+        if (plan)
+            DftiFreeDescriptor(&plan);
+    }
+    this->plans.clear();
+
+    MKL_free(this->window);
+    MKL_free(this->frames);
+    MKL_free(this->spectra);
+    MKL_free(this->output);
+    this->window   = nullptr;
+    this->frames   = nullptr;
+    this->spectra  = nullptr;
+    this->output   = nullptr;
+    this->capacity = 0;
 }
 
 inline double **cirction(const double x0,
@@ -397,4 +715,564 @@ cleanup:
 
     *n += *n;
     return output;
-}
\ No newline at end of file
+}
+
+Spectrogram_32f::Spectrogram_32f(const float *window, int wlen, int overlap, int bits, int nThreads)
+{
+    if (!window || wlen < 2 || overlap < 0 || overlap >= wlen)
+        throw std::invalid_argument("Invalid window or overlap");
+
+    this->wlen           = wlen;
+    this->shift          = wlen - overlap;
+    this->bins           = wlen / 2 + 1;
+    this->nThreads       = nThreads > 0 ? nThreads : omp_get_max_threads();
+    this->frameStride    = (wlen + 15) & ~15;
+    this->spectrumStride = (this->bins + 7) & ~7;
+    this->offset         = (float)(-20.0 * bits * log10(2.0));
+
+    const size_t threads = this->nThreads;
+    this->window         = (float *)MKL_malloc(wlen * sizeof(float), 64);
+    this->frames         = (float *)MKL_malloc(threads * this->frameStride * sizeof(float), 64);
+    this->spectra        = (Ipp32fc *)MKL_malloc(threads * this->spectrumStride * sizeof(Ipp32fc), 64);
+    if (!(this->window && this->frames && this->spectra))
+    {
+        this->release();
+        throw std::runtime_error("Can not allocate spectrogram buffers");
+    }
+    memcpy(this->window, window, wlen * sizeof(float));
+
+    this->plans.assign(this->nThreads, nullptr);
+    this->buffers.assign(this->nThreads, nullptr);
+    for (int i = 0; i < this->nThreads; ++i)
+    {
+        if (createFFT_IPP(this->plans[i], this->buffers[i], wlen) != ippStsNoErr)
+        {
+            this->release();
+            throw std::runtime_error("Can not create FFT spec");
+        }
+    }
+}
+
+IppStatus Spectrogram_32f::compute(const float *data, size_t dataLen, float *output)
+{
+    const long long nFrames = (long long)this->getFrames(dataLen);
+    IppStatus status        = ippStsNoErr;
+
+    if (!nFrames)
+        return ippStsNoErr;
+    if (!data || !output)
+        return ippStsNullPtrErr;
+
+    // vsLog10 of the dB conversion must not start MKL threads inside the frame loop
+    const int nth = MKL_Set_Num_Threads_Local(1);
+#pragma omp parallel for num_threads(this->nThreads) schedule(static)
+    for (long long i = 0; i < nFrames; ++i)
+    {
+        if (status)
+            continue;
+
+        const IppStatus local = this->transform(&data[i * this->shift], &output[i * this->bins], omp_get_thread_num());
+        if (local)
+        {
+#pragma omp critical
+            status = local;
+        }
+    }
+    MKL_Set_Num_Threads_Local(nth);
+
+    return status;
+}
+
+IppStatus Spectrogram_32f::compute(const float *data, size_t dataLen)
+{
+    const size_t nFrames = this->getFrames(dataLen);
+
+    if (nFrames > this->capacity)
+    {
+        float *grown = (float *)MKL_malloc(nFrames * this->bins * sizeof(float), 64);
+        if (!grown)
+            return ippStsNoMemErr;
+        MKL_free(this->output);
+        this->output   = grown;
+        this->capacity = nFrames;
+    }
+
+    this->outputFrames     = 0;
+    const IppStatus status = this->compute(data, dataLen, this->output);
+    if (!status)
+        this->outputFrames = nFrames;
+
+    return status;
+}
+
+IppStatus Spectrogram_32f::transform(const float *data, float *output, int thread)
+{
+    if (thread < 0 || thread >= this->nThreads)
+        return ippStsOutOfRangeErr;
+
+    Ipp32fc *spectrum      = &this->spectra[(size_t)thread * this->spectrumStride];
+    const IppStatus status = calculateFFT_IPP(this->plans[thread],
+                                              this->buffers[thread],
+                                              data,
+                                              this->window,
+                                              &this->frames[(size_t)thread * this->frameStride],
+                                              spectrum,
+                                              this->wlen);
+    if (status != ippStsNoErr)
+        return status;
+
+    magnitudeDb(spectrum, output, this->bins, this->offset);
+    return ippStsNoErr;
+}
+
+size_t Spectrogram_32f::getFrames(size_t dataLen) const
+{
+    return dataLen < (size_t)this->wlen ? 0 : (dataLen - this->wlen) / this->shift + 1;
+}
+
+int Spectrogram_32f::getBins() const
+{
+    return this->bins;
+}
+
+int Spectrogram_32f::getWindowLength() const
+{
+    return this->wlen;
+}
+
+int Spectrogram_32f::getShift() const
+{
+    return this->shift;
+}
+
+const float *Spectrogram_32f::getOutput() const
+{
+    return this->output;
+}
+
+size_t Spectrogram_32f::getOutputFrames() const
+{
+    return this->outputFrames;
+}
+
+Spectrogram_32f::~Spectrogram_32f()
+{
+    this->release();
+}
+
+void Spectrogram_32f::release()
+{
+    for (size_t i = 0; i < this->plans.size(); ++i)
+    {
+        ippsFree(this->plans[i]);
+        ippsFree(this->buffers[i]);
+    }
+    this->plans.clear();
+    this->buffers.clear();
+
+    MKL_free(this->window);
+    MKL_free(this->frames);
+    MKL_free(this->spectra);
+    MKL_free(this->output);
+    this->window   = nullptr;
+    this->frames   = nullptr;
+    this->spectra  = nullptr;
+    this->output   = nullptr;
+    this->capacity = 0;
+}
+
+STFT_Stream::STFT_Stream(const double *window, int wlen, int overlap, int bits, FrameCallback callback)
+    : spec(window, wlen, overlap, bits, 1)
+{
+    if (!callback)
+        throw std::invalid_argument("Frame callback is empty");
+
+    this->callback = std::move(callback);
+    this->wlen     = wlen;
+    this->shift    = this->spec.getShift();
+    this->tail.reserve(wlen);
+    this->frame.resize(wlen);
+    this->output.resize(this->spec.getBins());
+    this->reset();
+}
+
+long STFT_Stream::push(const double *data, size_t n)
+{
+    const size_t tailLen = this->tail.size();
+    long status          = DFTI_NO_ERROR;
+    size_t start         = 0;    // Next frame, counted from the first carried sample
+
+    if (!n)
+        return DFTI_NO_ERROR;
+    if (!data)
+        return DFTI_INVALID_CONFIGURATION;
+
+    // A failed frame is skipped but counted, later frames keep their positions and the tail its bound
+    for (; start + this->wlen <= tailLen + n; start += this->shift)
+    {
+        const double *src = this->frame.data();
+        if (start >= tailLen)
+            src = &data[start - tailLen];
+        else
+        {
+            // Frame spans the carried samples and this chunk
+            const size_t head = tailLen - start;
+            memcpy(this->frame.data(), &this->tail[start], head * sizeof(double));
+            memcpy(&this->frame[head], data, (this->wlen - head) * sizeof(double));
+        }
+
+        const long local = this->emit(src);
+        if (local && !status)
+            status = local;
+    }
+
+    // Carry the samples from the next frame start on, always fewer than wlen
+    if (start < tailLen)
+    {
+        this->tail.erase(this->tail.begin(), this->tail.begin() + start);
+        this->tail.insert(this->tail.end(), data, data + n);
+    }
+    else
+        this->tail.assign(data + (start - tailLen), data + n);
+    this->samples += n;
+
+    return status;
+}
+
+long STFT_Stream::flush()
+{
+    const uint64_t covered = this->frames ? (this->frames - 1) * this->shift + this->wlen : 0;
+    long status            = DFTI_NO_ERROR;
+
+    if (this->samples > covered)
+    {
+        memcpy(this->frame.data(), this->tail.data(), this->tail.size() * sizeof(double));
+        memset(&this->frame[this->tail.size()], 0, (this->wlen - this->tail.size()) * sizeof(double));
+        status = this->emit(this->frame.data());
+    }
+    this->reset();
+
+    return status;
+}
+
+void STFT_Stream::reset()
+{
+    this->samples = 0;
+    this->frames  = 0;
+    this->tail.clear();
+}
+
+int STFT_Stream::getBins() const
+{
+    return this->spec.getBins();
+}
+
+uint64_t STFT_Stream::getFrames() const
+{
+    return this->frames;
+}
+
+uint64_t STFT_Stream::getSamples() const
+{
+    return this->samples;
+}
+
+long STFT_Stream::emit(const double *data)
+{
+    const long status = this->spec.transform(data, this->output.data());
+    if (!status)
+        this->callback(this->output.data(), this->frames);
+    ++this->frames;
+
+    return status;
+}
+
+STFT_Inverse::STFT_Inverse(const double *window, int wlen, int overlap, int nThreads)
+{
+    if (!window || wlen < 2 || overlap < 0 || overlap >= wlen)
+        throw std::invalid_argument("Invalid window or overlap");
+
+    this->wlen           = wlen;
+    this->shift          = wlen - overlap;
+    this->bins           = wlen / 2 + 1;
+    this->nThreads       = nThreads > 0 ? nThreads : omp_get_max_threads();
+    this->frameStride    = (wlen + 7) & ~7;
+    this->spectrumStride = (this->bins + 3) & ~3;
+
+    const size_t threads = this->nThreads;
+    this->window         = (double *)MKL_malloc(wlen * sizeof(double), 64);
+    this->frames         = (double *)MKL_malloc(threads * this->frameStride * sizeof(double), 64);
+    this->spectra        = (MKL_Complex16 *)MKL_malloc(threads * this->spectrumStride * sizeof(MKL_Complex16), 64);
+    if (!(this->window && this->frames && this->spectra))
+    {
+        this->release();
+        throw std::runtime_error("Can not allocate inverse STFT buffers");
+    }
+    memcpy(this->window, window, wlen * sizeof(double));
+
+    // Backward transform of the forward descriptor, unscaled so it inverts the 1/wlen forward scale
+    this->plans.assign(this->nThreads, nullptr);
+    for (int i = 0; i < this->nThreads; ++i)
+    {
+        long status = createFFT_MKL(&this->plans[i], wlen);
+        if (!status)
+            status = DftiCommitDescriptor(this->plans[i]);
+        if (status && !DftiErrorClass(status, DFTI_NO_ERROR))
+        {
+            this->release();
+            throw std::runtime_error("Can not create FFT descriptor");
+        }
+    }
+}
+
+long STFT_Inverse::compute(const MKL_Complex16 *spectra, size_t nFrames, double *output)
+{
+    const long long length = (long long)this->getLength(nFrames);
+    long status            = DFTI_NO_ERROR;
+
+    if (!nFrames)
+        return DFTI_NO_ERROR;
+    if (!spectra || !output)
+        return DFTI_INVALID_CONFIGURATION;
+
+    // Runs of at least wlen / shift frames, run r ends before run r + 2 starts so even and odd runs can each be added
+    // in parallel
+    const long long minRun = (this->wlen + this->shift - 1) / this->shift;
+    const long long spread = ((long long)nFrames + 2LL * this->nThreads - 1) / (2LL * this->nThreads);
+    const long long run    = spread > minRun ? spread : minRun;
+    const long long nRuns  = ((long long)nFrames + run - 1) / run;
+
+    memset(output, 0, length * sizeof(double));
+
+    const int nth = MKL_Set_Num_Threads_Local(1);    // Frames are the parallel dimension
+    for (int parity = 0; parity < 2 && !status; ++parity)
+    {
+#pragma omp parallel for num_threads(this->nThreads) schedule(dynamic)
+        for (long long r = parity; r < nRuns; r += 2)
+        {
+            const long long last = (r + 1) * run < (long long)nFrames ? (r + 1) * run : (long long)nFrames;
+            const int thread     = omp_get_thread_num();
+
+            for (long long i = r * run; i < last && !status; ++i)
+            {
+                const long local = this->inverseFrame(thread, &spectra[i * this->bins], &output[i * this->shift]);
+                if (local)
+                {
+#pragma omp critical
+                    status = local;
+                }
+            }
+        }
+    }
+    MKL_Set_Num_Threads_Local(nth);
+    if (status)
+        return status;
+
+    // Divide by the squared window summed over the frames covering each sample
+#pragma omp parallel for num_threads(this->nThreads) schedule(static)
+    for (long long n = 0; n < length; ++n)
+    {
+        const long long first = n < this->wlen ? 0 : (n - this->wlen) / this->shift + 1;
+        const long long last  = n / this->shift < (long long)nFrames ? n / this->shift : (long long)nFrames - 1;
+        double envelope       = 0;
+
+        for (long long i = first; i <= last; ++i)
+        {
+            const double w = this->window[n - i * this->shift];
+            envelope += w * w;
+        }
+        if (envelope > ISTFT_ENVELOPE_MIN)
+            output[n] /= envelope;
+    }
+
+    return DFTI_NO_ERROR;
+}
+
+size_t STFT_Inverse::getLength(size_t nFrames) const
+{
+    return nFrames ? (nFrames - 1) * this->shift + this->wlen : 0;
+}
+
+int STFT_Inverse::getBins() const
+{
+    return this->bins;
+}
+
+int STFT_Inverse::getWindowLength() const
+{
+    return this->wlen;
+}
+
+int STFT_Inverse::getShift() const
+{
+    return this->shift;
+}
+
+STFT_Inverse::~STFT_Inverse()
+{
+    this->release();
+}
+
+/// Inverse DFT of one spectrum, windowed and added to output
+long STFT_Inverse::inverseFrame(int thread, const MKL_Complex16 *spectrum, double *output)
+{
+    double *frame        = &this->frames[(size_t)thread * this->frameStride];
+    MKL_Complex16 *input = &this->spectra[(size_t)thread * this->spectrumStride];
+
+    memcpy(input, spectrum, this->bins * sizeof(MKL_Complex16));    // Backward transform may overwrite its input
+    const long status = DftiComputeBackward(this->plans[thread], input, frame);    // Compute inverse DFT
+    if (status && !DftiErrorClass(status, DFTI_NO_ERROR))
+        return status;
+
+    for (int j = 0; j < this->wlen; ++j)
+        output[j] += frame[j] * this->window[j];
+
+    return DFTI_NO_ERROR;
+}
+
+void STFT_Inverse::release()
+{
+    for (DFTI_DESCRIPTOR_HANDLE &plan : this->plans)
+    {
+        if (plan)
+            DftiFreeDescriptor(&plan);
+    }
+    this->plans.clear();
+
+    MKL_free(this->window);
+    MKL_free(this->frames);
+    MKL_free(this->spectra);
+    this->window  = nullptr;
+    this->frames  = nullptr;
+    this->spectra = nullptr;
+}
+
+Hilbert_Plan::Hilbert_Plan(int wlen, int nThreads)
+{
+    if (wlen < 2)
+        throw std::invalid_argument("Invalid Hilbert transform length");
+
+    this->wlen     = wlen;
+    this->nThreads = nThreads > 0 ? nThreads : omp_get_max_threads();
+    this->specs.assign(this->nThreads, nullptr);
+    this->buffers.assign(this->nThreads, nullptr);
+    this->analytic.assign(this->nThreads, nullptr);
+
+    for (int i = 0; i < this->nThreads; ++i)
+    {
+        IppStatus status = createhilbert(this->specs[i], this->buffers[i], wlen);
+        if (status == ippStsNoErr)
+            status = ippsHilbertInit_32f32fc(wlen, ippAlgHintNone, this->specs[i], this->buffers[i]);
+        this->analytic[i] = (Ipp32fc *)MKL_malloc(wlen * sizeof(Ipp32fc), 64);
+        if (status != ippStsNoErr || !this->analytic[i])
+        {
+            this->release();
+            throw std::runtime_error("Can not create Hilbert transform");
+        }
+    }
+}
+
+IppStatus Hilbert_Plan::transform(const float *data, Ipp32fc *analytic, int thread)
+{
+    if (thread < 0 || thread >= this->nThreads)
+        return ippStsOutOfRangeErr;
+
+    return ippsHilbert_32f32fc(data, analytic, this->specs[thread], this->buffers[thread]);
+}
+
+IppStatus Hilbert_Plan::analyze(const float *data,
+                                size_t nSignals,
+                                size_t stride,
+                                float *envelope,
+                                float *phase,
+                                float *frequency,
+                                float sampleRate)
+{
+    const float scale = sampleRate / (float)(2 * M_PI);
+    IppStatus status  = ippStsNoErr;
+
+    if (!data)
+        return ippStsNullPtrErr;
+
+#pragma omp parallel for num_threads(this->nThreads) schedule(static)
+    for (long long i = 0; i < (long long)nSignals; ++i)
+    {
+        if (status)
+            continue;
+
+        const int thread = omp_get_thread_num();
+        const size_t row = (size_t)i * this->wlen;
+        Ipp32fc *z       = this->analytic[thread];
+        IppStatus local  = this->transform(&data[(size_t)i * stride], z, thread);
+
+        if (!local && envelope)
+            local = ippsMagnitude_32fc(z, &envelope[row], this->wlen);
+        if (!local && phase)
+            local = ippsPhase_32fc(z, &phase[row], this->wlen);
+        if (!local && frequency)
+        {
+            float *out = &frequency[row];
+            for (int n = 0; n + 1 < this->wlen; ++n)
+            {
+                // Angle of z[n + 1] * conj(z[n])
+                const float re = z[n + 1].re * z[n].re + z[n + 1].im * z[n].im;
+                const float im = z[n + 1].im * z[n].re - z[n + 1].re * z[n].im;
+                out[n]         = atan2f(im, re) * scale;
+            }
+            out[this->wlen - 1] = out[this->wlen - 2];
+        }
+
+        if (local)
+        {
+#pragma omp critical
+            status = local;
+        }
+    }
+
+    return status;
+}
+
+Hilbert_Plan &Hilbert_Plan::cached(int wlen)
+{
+    // Threads of a parallel region get single thread plans, n callers would otherwise hold n * n specs
+    const int nThreads                  = omp_in_parallel() ? 1 : omp_get_max_threads();
+    std::unique_ptr<Hilbert_Plan> &plan = cache()[std::make_pair(wlen, nThreads)];
+    if (!plan)
+        plan.reset(new Hilbert_Plan(wlen, nThreads));
+    return *plan;
+}
+
+void Hilbert_Plan::clearCache()
+{
+    cache().clear();
+}
+
+int Hilbert_Plan::getLength() const
+{
+    return this->wlen;
+}
+
+Hilbert_Plan::~Hilbert_Plan()
+{
+    this->release();
+}
+
+/// Per thread, plans are never shared between threads that call into them at the same time
+std::map<std::pair<int, int>, std::unique_ptr<Hilbert_Plan>> &Hilbert_Plan::cache()
+{
+    thread_local std::map<std::pair<int, int>, std::unique_ptr<Hilbert_Plan>> plans;
+    return plans;
+}
+
+void Hilbert_Plan::release()
+{
+    for (size_t i = 0; i < this->specs.size(); ++i)
+    {
+        ippFree(this->specs[i]);
+        ippFree(this->buffers[i]);
+        MKL_free(this->analytic[i]);
+    }
+    this->specs.clear();
+    this->buffers.clear();
+    this->analytic.clear();
+}